@@ -42,6 +42,10 @@ function (add_build_model_command MODEL_PATH)
   get_filename_component(MODEL_FILENAME "${MODEL_PATH}" NAME_WLE)
   set(CONVERTED_MODEL_PATH "${MODELS_BUILD_DIR_JSON}/${MODEL_FILENAME}.json")
   set(FINAL_MODEL_PATH "${ASSETS_DIR}/${MODEL_FILENAME}.fm")
+  set(CONVERTER_ARGS)
+  if (MODEL_PATH IN_LIST models_without_lods)
+    list(APPEND CONVERTER_ARGS --lods 0)
+  endif()
 
   # Convert from .blend to .json
   add_custom_command(
@@ -56,7 +60,7 @@ function (add_build_model_command MODEL_PATH)
     COMMENT "Converting ${CONVERTED_MODEL_PATH} to ${FINAL_MODEL_PATH}"
     DEPENDS "${CONVERTED_MODEL_PATH}"
     OUTPUT "${FINAL_MODEL_PATH}"
-    COMMAND "${MODEL_CONVERTER_EXECUTABLE}" "${CONVERTED_MODEL_PATH}" "${FINAL_MODEL_PATH}" "${ASSETS_DIR_RAW}"
+    COMMAND "${MODEL_CONVERTER_EXECUTABLE}" "${CONVERTED_MODEL_PATH}" "${FINAL_MODEL_PATH}" "${ASSETS_DIR_RAW}" ${CONVERTER_ARGS}
   )
   return (PROPAGATE FINAL_MODEL_PATH)
 endfunction()
@@ -180,7 +180,7 @@ const ActionListBuilder& ActionListBuilder::rotateHeadTowards(AnimatedModelObjec
     const auto start = object.model.armature.joints[4].localTransform.rotation;
     actionList.addAction(eastl::make_unique<LerpAction>(
         [&object, start, target](psyqo::FixedPoint<> lerpFactor) {
-            object.manualHeadRotation = slerp(start, target, lerpFactor);
+            object.manualHeadRotation = nlerp(start, target, lerpFactor);
         },
         time));
     return *this;
@@ -193,7 +193,7 @@ const ActionListBuilder& ActionListBuilder::rotateHeadTowards(AnimatedModelObjec
 {
     actionList.addAction(eastl::make_unique<LerpAction>(
         [&object, start, target](psyqo::FixedPoint<> lerpFactor) {
-            object.manualHeadRotation = slerp(start, target, lerpFactor);
+            object.manualHeadRotation = nlerp(start, target, lerpFactor);
         },
         time));
     return *this;
@@ -1,10 +1,20 @@
 #include "CDLoader.h"
 
+#include <EASTL/algorithm.h>
+#include <common/syscalls/syscalls.h>
+
 #include <Audio/SoundPlayer.h>
+#include <Core/FileReader.h>
 #include <Game.h>
 #include <Graphics/TimFile.h>
 #include <Level.h>
 
+namespace
+{
+constexpr std::uint32_t SECTOR_SIZE = 2048;
+constexpr std::uint32_t ARCHIVE_MAGIC = 0x4B434150; // "PACK"
+}
+
 CDLoader::CDLoader(Game& game) : game(game)
 {}
 
@@ -77,10 +87,95 @@ void CDLoader::loadLevel(eastl::string_view filename, Level& level)
     });
 }
 
+void CDLoader::openArchive(eastl::string_view filename)
+{
+    if (!isoParser.initialized()) {
+        isoParser.initialize([this, filename](bool success) {
+            if (!success) {
+                game.gameLoadCoroutine.resume();
+                return;
+            }
+            openArchive(filename);
+        });
+        return;
+    }
+
+    isoParser.getDirentry(filename, &archiveDirEntry, [this](bool success) {
+        if (!success) {
+            ramsyscall_printf("No archive, files will be read from the ISO\n");
+            game.gameLoadCoroutine.resume();
+            return;
+        }
+
+        // the header is read first: the whole table of contents usually fits into its sector
+        readSectors(archiveDirEntry.LBA, SECTOR_SIZE, [this](eastl::vector<uint8_t>&& header) {
+            util::FileReader fr{
+                .bytes = header.data(),
+            };
+            const auto magic = fr.GetUInt32();
+            if (magic != ARCHIVE_MAGIC) {
+                ramsyscall_printf("Invalid archive magic, files will be read from the ISO\n");
+                game.gameLoadCoroutine.resume();
+                return;
+            }
+            const auto numEntries = fr.GetUInt32();
+            const auto headerSectors = fr.GetUInt32();
+
+            const auto readEntries = [this, numEntries](const eastl::vector<uint8_t>& data) {
+                util::FileReader fr{
+                    .bytes = data.data(),
+                    .cursor = sizeof(std::uint32_t) * 3,
+                };
+                archiveEntries.resize(numEntries);
+                for (auto& entry : archiveEntries) {
+                    entry.hash = fr.GetUInt32();
+                    entry.sector = fr.GetUInt32();
+                    entry.size = fr.GetUInt32();
+                }
+                ramsyscall_printf("Opened archive: %d files\n", (int)numEntries);
+                game.gameLoadCoroutine.resume();
+            };
+
+            if (headerSectors == 1) {
+                readEntries(header);
+                return;
+            }
+            readSectors(
+                archiveDirEntry.LBA,
+                headerSectors * SECTOR_SIZE,
+                [readEntries](eastl::vector<uint8_t>&& data) { readEntries(data); });
+        });
+    });
+}
+
+const ArchiveEntry* CDLoader::findInArchive(StringHash hash) const
+{
+    const auto it = eastl::lower_bound(
+        archiveEntries.begin(),
+        archiveEntries.end(),
+        hash.value,
+        [](const ArchiveEntry& entry, std::uint32_t h) { return entry.hash < h; });
+    if (it == archiveEntries.end() || it->hash != hash.value) {
+        return nullptr;
+    }
+    return &*it;
+}
+
 void CDLoader::loadFromCD(
     eastl::string_view filename,
     eastl::function<void(eastl::vector<uint8_t>&&)>&& callback)
 {
+    if (const auto* entry = findInArchive(StringViewWithHash{filename}.hash); entry) {
+        readSectors(
+            archiveDirEntry.LBA + entry->sector,
+            entry->size,
+            [this, cb = eastl::move(callback)](eastl::vector<uint8_t>&& buffer) {
+                cb(eastl::move(buffer));
+                game.gameLoadCoroutine.resume();
+            });
+        return;
+    }
+
     cdromLoader.readFile(
         filename,
         game.gpu(),
@@ -90,3 +185,21 @@ void CDLoader::loadFromCD(
             game.gameLoadCoroutine.resume();
         });
 }
+
+void CDLoader::readSectors(
+    std::uint32_t lba,
+    std::uint32_t size,
+    eastl::function<void(eastl::vector<uint8_t>&&)>&& callback)
+{
+    const auto numSectors = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    readBuffer.resize(numSectors * SECTOR_SIZE);
+    cdrom.readSectors(
+        lba,
+        numSectors,
+        readBuffer.data(),
+        [this, size, cb = eastl::move(callback)](bool success) {
+            psyqo::Kernel::assert(success, "Failed to read sectors");
+            readBuffer.resize(size);
+            cb(eastl::move(readBuffer));
+        });
+}
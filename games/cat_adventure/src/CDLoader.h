@@ -5,6 +5,8 @@
 
 #include <EASTL/vector.h>
 
+#include <Core/StringHash.h>
+
 struct TextureInfo;
 struct Font;
 struct ModelData;
@@ -15,6 +17,13 @@ struct Level;
 
 class Game;
 
+// File in the archive (see tools/packtool)
+struct ArchiveEntry {
+    std::uint32_t hash; // hash of the ISO name ("CATO.FM;1")
+    std::uint32_t sector; // from the start of the archive
+    std::uint32_t size;
+};
+
 struct CDLoader {
     CDLoader(Game& game);
     void init();
@@ -29,13 +38,29 @@ struct CDLoader {
     void loadAnimations(eastl::string_view filename, eastl::vector<SkeletalAnimation>& animations);
     void loadLevel(eastl::string_view filename, Level& level);
 
+    // Reads the archive's table of contents (resumes gameLoadCoroutine when done).
+    // After that, files which are in the archive are read from it with one sector read
+    // instead of an ISO9660 lookup. Without the archive everything is read from the ISO.
+    void openArchive(eastl::string_view filename);
+    const ArchiveEntry* findInArchive(StringHash hash) const;
+
+    // Reads from the archive if the file is in it (and the archive is open)
     void loadFromCD(
         eastl::string_view filename,
         eastl::function<void(eastl::vector<uint8_t>&&)>&& callback);
 
+    void readSectors(
+        std::uint32_t lba,
+        std::uint32_t size,
+        eastl::function<void(eastl::vector<uint8_t>&&)>&& callback);
+
     psyqo::CDRomDevice cdrom;
     psyqo::ISO9660Parser isoParser{&cdrom};
     psyqo::paths::CDRomLoader cdromLoader;
 
+    psyqo::ISO9660Parser::DirEntry archiveDirEntry;
+    eastl::vector<ArchiveEntry> archiveEntries; // sorted by hash, empty if there's no archive
+    eastl::vector<uint8_t> readBuffer;
+
     Game& game;
 };
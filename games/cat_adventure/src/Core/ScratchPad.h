@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+// 1KB of fast RAM (the CPU's data cache used as memory)
+#define SCRATCH_PAD 0x1f800000
+inline constexpr std::size_t SCRATCH_PAD_SIZE = 1024;
+
+// Nothing is kept in the scratchpad between calls, its users take turns:
+// - while drawing, Renderer stores SubdivData (see Subdivision.h) and transformed vertices there
+// - during the update, animateArmature (rotation blends) and Armature::calculateTransforms
+//   (parent transforms) use it as a temporary buffer for one call
+// Drawing and updating never overlap, so each user can overwrite all of it without saving
+// the previous contents.
@@ -37,6 +37,10 @@ void DebugMenu::init(
             .text = "Draw collision",
             .checkbox = true,
         },
+        MenuItem{
+            .text = "Early submit",
+            .checkbox = true,
+        },
     };
 }
 
@@ -30,6 +30,7 @@ struct DebugMenu {
     static constexpr auto FOLLOW_CAMERA_ITEM_ID = 2;
     static constexpr auto MUTE_MUSIC_ITEM_ID = 3;
     static constexpr auto DRAW_COLLISION_ITEM_ID = 4;
+    static constexpr auto EARLY_SUBMIT_ITEM_ID = 5;
 
     eastl::vector<MenuItem> menuItems;
 
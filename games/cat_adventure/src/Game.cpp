@@ -53,6 +53,11 @@ psyqo::Coroutine<> loadCoroutine(Game& game)
 
     psyqo::Coroutine<>::Awaiter awaiter = game.gameLoadCoroutine.awaiter();
 
+    if (game.firstLoad) { // archive (the ISO is used for all files if it's not there)
+        game.cd.openArchive("GAME.PAK;1");
+        co_await awaiter;
+    }
+
     if (game.firstLoad) { // core
         game.cd.loadTIM("FONT.TIM;1", game.fontTexture);
         co_await awaiter;
@@ -164,6 +169,16 @@ psyqo::Coroutine<> loadCoroutine(Game& game)
         game.cd.loadAnimations("HUMAN.ANM;1", game.humanAnimations);
         co_await awaiter;
 
+        if (game.resourceCache.resourceLoaded<ModelData>(HUMAN_MODEL_HASH)) {
+            const auto& humanModel =
+                game.resourceCache.getResource<ModelData>(HUMAN_MODEL_HASH);
+            bakeAnimations(game.humanBakedAnimations,
+                humanModel.armature,
+                game.humanAnimations,
+                {"Idle"_sh, "Walk"_sh},
+                Game::HUMAN_BAKED_ANIMATIONS_BUDGET);
+        }
+
         game.cd.loadAnimations("CATO.ANM;1", game.catAnimations);
         co_await awaiter;
     }
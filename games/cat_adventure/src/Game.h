@@ -11,6 +11,7 @@
 #include <Audio/VabFile.h>
 #include <Core/PadManager.h>
 #include <Dev/DebugMenu.h>
+#include <Graphics/BakedAnimation.h>
 #include <Graphics/Font.h>
 #include <Graphics/Renderer.h>
 #include <Graphics/SkeletalAnimation.h>
@@ -62,6 +63,10 @@ public:
     eastl::vector<SkeletalAnimation> humanAnimations;
     eastl::vector<SkeletalAnimation> catAnimations;
 
+    // NPCs play these all the time, so their poses are precomputed (RAM budget in bytes)
+    static constexpr std::size_t HUMAN_BAKED_ANIMATIONS_BUDGET = 64 * 1024;
+    BakedAnimations humanBakedAnimations;
+
     // audio
     MidiFile midi;
     VabFile vab;
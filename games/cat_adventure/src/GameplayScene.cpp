@@ -165,6 +165,7 @@ void GameplayScene::start(StartReason reason)
     npc.model = game.resourceCache.getResource<ModelData>(HUMAN_MODEL_HASH).makeInstance();
     npc.jointGlobalTransforms.resize(npc.model.armature.joints.size());
     npc.animator.animations = &game.humanAnimations;
+    npc.animator.bakedAnimations = &game.humanBakedAnimations;
     npc.animator.setAnimation("Idle"_sh);
 
     if (game.level.id == 0) {
@@ -202,6 +203,10 @@ void GameplayScene::start(StartReason reason)
 
     player.animator.setAnimation("Idle"_sh);
     player.model.armature.selectedJoint = 4;
+
+    animationScheduler.clear();
+    animationScheduler.add(player, true);
+    animationScheduler.add(npc);
 }
 
 void GameplayScene::initUI()
@@ -221,6 +226,8 @@ void GameplayScene::initDebugMenu()
     game.debugMenu.menuItems[DebugMenu::FOLLOW_CAMERA_ITEM_ID].valuePtr = &followCamera;
     game.debugMenu.menuItems[DebugMenu::MUTE_MUSIC_ITEM_ID].valuePtr = &game.songPlayer.musicMuted;
     game.debugMenu.menuItems[DebugMenu::DRAW_COLLISION_ITEM_ID].valuePtr = &collisionDrawn;
+    game.debugMenu.menuItems[DebugMenu::EARLY_SUBMIT_ITEM_ID].valuePtr =
+        &game.renderer.earlySubmit;
 }
 
 void GameplayScene::frame()
@@ -649,6 +656,7 @@ void GameplayScene::update()
         }
     }
 
+    animationScheduler.update();
     player.update(game.frameDtMcs);
     npc.update(game.frameDtMcs);
 
@@ -835,7 +843,8 @@ void GameplayScene::draw(Renderer& renderer)
     auto& primBuffer = renderer.getPrimBuffer();
     auto& gp = gpu();
 
-    primBuffer.reset();
+    fpsCounter.beginDraw(gp);
+    renderer.beginFrame();
 
     // set dithering ON globally
     auto& tpage = primBuffer.allocateFragment<psyqo::Prim::TPage>();
@@ -946,9 +955,19 @@ void GameplayScene::draw(Renderer& renderer)
     if (game.level.id == 1) {
         renderer.drawTiles(game.level.modelData, game.level.tileMap, camera);
     }
+    fpsCounter.endPass(gp, FPSCounter::DrawPass::Tiles);
+
+    if (renderer.earlySubmit) {
+        // the GPU can start drawing the far part of the scene while the objects are transformed
+        const auto chainWasIdle = gp.isChainIdle();
+        renderer.chainFarPass();
+        fpsCounter.farPassChained(gp, chainWasIdle);
+    }
 
     gp.pumpCallbacks();
 
+    renderer.numObjectsCulled = 0;
+
     // draw static objects without rotation (R won't be changed)
     for (auto& staticObject : game.level.staticObjects) {
         if (!staticObject.hasRotation()) {
@@ -962,6 +981,7 @@ void GameplayScene::draw(Renderer& renderer)
             renderer.drawMeshObject(staticObject, camera, true);
         }
     }
+    fpsCounter.endPass(gp, FPSCounter::DrawPass::StaticObjects);
 
     gp.pumpCallbacks();
 
@@ -970,6 +990,7 @@ void GameplayScene::draw(Renderer& renderer)
         renderer.drawAnimatedModelObject(player, camera);
         renderer.drawAnimatedModelObject(npc, camera);
     }
+    fpsCounter.endPass(gp, FPSCounter::DrawPass::DynamicObjects);
 
     gp.pumpCallbacks();
 
@@ -1097,6 +1118,9 @@ void GameplayScene::draw(Renderer& renderer)
         game.pad.getPadType()); */
 
     game.debugMenu.draw(renderer);
+
+    fpsCounter.endPass(gp, FPSCounter::DrawPass::Overlays);
+    fpsCounter.endDraw(gp);
 }
 
 void GameplayScene::drawDebugInfo(Renderer& renderer)
@@ -1215,9 +1239,24 @@ void GameplayScene::drawDebugInfo(Renderer& renderer)
         game.romFont.chainprintf(game.gpu(),
             {{.x = 16, .y = 80}},
             textCol,
-            "pb used: %d, tiles drawn: %d",
+            "pb used: %d (max %d), tiles drawn: %d, culled: %d",
             (int)renderer.getPrimBuffer().used(),
-            renderer.numTilesDrawn);
+            (int)renderer.getPrimBuffer().getPeakUsage(),
+            renderer.numTilesDrawn,
+            renderer.numObjectsCulled);
+
+        const auto& frameStats = renderer.getLastFrameStats();
+        const auto& peakStats = renderer.getPeakFrameStats();
+        game.romFont.chainprintf(game.gpu(),
+            {{.x = 16, .y = 96}},
+            textCol,
+            "prims: %d (max %d), skipped: %d, ot: %d-%d (max %d)",
+            frameStats.numPrimsInserted,
+            peakStats.numPrimsInserted,
+            frameStats.numPrimsSkipped,
+            frameStats.minOTZ,
+            frameStats.maxOTZ,
+            peakStats.maxOTZ);
 
         game.romFont.chainprintf(game.gpu(),
             {{.x = 16, .y = 48}},
@@ -1225,6 +1264,28 @@ void GameplayScene::drawDebugInfo(Renderer& renderer)
             "FPS: %.2f, fd: %d",
             fpsCounter.getMovingAverage(),
             fadeLevel);
+
+        const auto& passTimes = fpsCounter.passTimes;
+        game.romFont.chainprintf(game.gpu(),
+            {{.x = 16, .y = 112}},
+            textCol,
+            "draw: %dus (%d/%d/%d/%d), gpu bound: %d",
+            (int)fpsCounter.drawTime,
+            (int)passTimes[(std::size_t)FPSCounter::DrawPass::Tiles],
+            (int)passTimes[(std::size_t)FPSCounter::DrawPass::StaticObjects],
+            (int)passTimes[(std::size_t)FPSCounter::DrawPass::DynamicObjects],
+            (int)passTimes[(std::size_t)FPSCounter::DrawPass::Overlays],
+            fpsCounter.numGPUBoundFrames);
+
+        game.romFont.chainprintf(game.gpu(),
+            {{.x = 16, .y = 128}},
+            textCol,
+            "early: %d, far started/deferred/busy: %d/%d/%d, late: %d",
+            (int)renderer.earlySubmit,
+            fpsCounter.numFarPassesStarted,
+            fpsCounter.numFarPassesDeferred,
+            fpsCounter.numFarPassesBusy,
+            frameStats.numLateFarPrims);
     }
 }
 
@@ -1250,6 +1311,45 @@ void GameplayScene::dumpDebugInfoToTTY()
         player.transform.translation.z,
         player.getYaw());
     ramsyscall_printf("%s\n", str.c_str());
+
+    // dump prim buffer/OT usage (last frame and peak)
+    auto& renderer = game.renderer;
+    const auto& frameStats = renderer.getLastFrameStats();
+    const auto& peakStats = renderer.getPeakFrameStats();
+    const auto& primBuffer = renderer.getPrimBuffer();
+    ramsyscall_printf("prim buffer: %d/%d bytes, peak frame: %d, peak total: %d\n",
+        (int)frameStats.primBufferUsed,
+        Renderer::PRIMBUFFLEN,
+        (int)primBuffer.getPeakFrameUsage(),
+        (int)primBuffer.getPeakUsage());
+    static constexpr eastl::array<const char*, (std::size_t)PrimStatsType::Count> primTypeNames{
+        "G3", "G4", "GT3", "GT4", "SPRT", "LINE", "other"};
+    for (std::size_t i = 0; i < primTypeNames.size(); ++i) {
+        ramsyscall_printf("  %s: %d bytes (peak %d)\n",
+            primTypeNames[i],
+            (int)frameStats.primBytes[i],
+            (int)peakStats.primBytes[i]);
+    }
+    ramsyscall_printf("prims: %d (peak %d), culled by nclip: %d (peak %d), "
+                      "by depth: %d (peak %d), skipped: %d (peak %d)\n",
+        frameStats.numPrimsInserted,
+        peakStats.numPrimsInserted,
+        frameStats.numCulledNclip,
+        peakStats.numCulledNclip,
+        frameStats.numCulledDepth,
+        peakStats.numCulledDepth,
+        frameStats.numPrimsSkipped,
+        peakStats.numPrimsSkipped);
+    ramsyscall_printf("OT buckets: %d-%d (peak %d-%d, OT_SIZE = %d)\n",
+        frameStats.minOTZ,
+        frameStats.maxOTZ,
+        peakStats.minOTZ,
+        peakStats.maxOTZ,
+        Renderer::OT_SIZE);
+    ramsyscall_printf("pose updates: %d, screen radius: player %d, npc %d\n",
+        animationScheduler.getNumPoseUpdates(),
+        player.screenRadius,
+        npc.screenRadius);
 }
 
 void GameplayScene::switchLevel(int levelId)
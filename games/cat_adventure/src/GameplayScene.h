@@ -4,6 +4,7 @@
 
 #include <Camera.h>
 #include <Core/StringHash.h>
+#include <Graphics/AnimationScheduler.h>
 #include <Graphics/SkeletalAnimation.h>
 #include <Graphics/SkeletonAnimator.h>
 #include <Math/Quaternion.h>
@@ -63,6 +64,7 @@ private:
     // game objects
     AnimatedModelObject player;
     AnimatedModelObject npc;
+    AnimationScheduler animationScheduler;
 
     Camera camera;
 
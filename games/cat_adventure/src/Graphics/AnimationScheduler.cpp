@@ -0,0 +1,35 @@
+#include "AnimationScheduler.h"
+
+#include <Object.h>
+
+void AnimationScheduler::add(AnimatedModelObject& object, bool alwaysFullRate)
+{
+    // not drawn yet - the first pose must be calculated right away
+    object.screenRadius = AnimatedModelObject::SCREEN_RADIUS_UNKNOWN;
+    objects.push_back({
+        .object = &object,
+        .phase = (std::uint8_t)objects.size(),
+        .alwaysFullRate = alwaysFullRate,
+    });
+}
+
+void AnimationScheduler::update()
+{
+    ++frame;
+    numPoseUpdates = 0;
+    for (auto& entry : objects) {
+        auto& object = *entry.object;
+
+        std::uint32_t period = 4;
+        if (entry.alwaysFullRate || object.screenRadius >= FULL_RATE_SCREEN_RADIUS) {
+            period = 1;
+        } else if (object.screenRadius >= HALF_RATE_SCREEN_RADIUS) {
+            period = 2;
+        }
+
+        object.updatePose = ((frame + entry.phase) & (period - 1)) == 0;
+        if (object.updatePose) {
+            ++numPoseUpdates;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/vector.h>
+
+struct AnimatedModelObject;
+
+// Chooses how often the poses of animated objects are calculated: objects which are small
+// on screen are updated at half rate, tiny and off-screen ones at quarter rate.
+// Updates of different objects are staggered across frames, so the cost stays flat.
+// Skipped objects keep their previous joint transforms (their animation time still advances).
+class AnimationScheduler {
+public:
+    // radius on screen (in pixels) starting from which the object is updated at full/half rate
+    static constexpr int FULL_RATE_SCREEN_RADIUS = 24;
+    static constexpr int HALF_RATE_SCREEN_RADIUS = 12;
+
+    void clear() { objects.clear(); }
+    // alwaysFullRate - for objects which must never lag (e.g. the player)
+    void add(AnimatedModelObject& object, bool alwaysFullRate = false);
+
+    // Sets AnimatedModelObject::updatePose - must be called before the objects are updated
+    void update();
+
+    // number of objects which have their poses calculated this frame
+    int getNumPoseUpdates() const { return numPoseUpdates; }
+
+private:
+    struct Entry {
+        AnimatedModelObject* object;
+        std::uint8_t phase; // staggers the updates of objects with the same rate
+        bool alwaysFullRate;
+    };
+    eastl::vector<Entry> objects;
+
+    std::uint32_t frame{0};
+    int numPoseUpdates{0};
+};
@@ -1,45 +1,189 @@
 #include "Armature.h"
 
-#include "RainbowColors.h"
+#include <psyqo/gte-kernels.hh>
+#include <psyqo/gte-registers.hh>
 
-#include <common/syscalls/syscalls.h>
+#include <Core/ScratchPad.h>
 
-#include <EASTL/fixed_string.h>
-#include <psyqo/gte-kernels.hh>
-#include <psyqo/xprintf.h>
+namespace
+{
+// Global transform of a joint in the format which GTE's rotation and translation registers take,
+// so making it the current parent is just a few register writes
+struct PackedJointTransform {
+    std::uint32_t rotation[5]; // r11r12, r13r21, r22r23, r31r32, r33
+    psyqo::Vec3 translation;
+};
+
+// Parent transforms are read back from the scratchpad for each joint, which is much faster
+// than reading them from main RAM.
+constexpr std::size_t MAX_SCRATCHPAD_JOINTS = SCRATCH_PAD_SIZE / sizeof(PackedJointTransform);
+
+std::uint32_t packPair(std::int32_t lo, std::int32_t hi)
+{
+    return ((std::uint32_t)lo & 0xFFFF) | ((std::uint32_t)hi << 16);
+}
+
+// Same as Quaternion::toRotationMatrix, but the nine products are done by GTE (three gpf's).
+// They're unshifted, so 2 * (a * b) is only rounded once.
+void quaternionToMatrix(const Quaternion& q, std::int32_t m[3][3])
+{
+    const std::int32_t w = q.w.value;
+    const std::int32_t x = q.x.value;
+    const std::int32_t y = q.y.value;
+    const std::int32_t z = q.z.value;
+
+    psyqo::GTE::write<psyqo::GTE::Register::IR0, psyqo::GTE::Unsafe>(x);
+    psyqo::GTE::write<psyqo::GTE::Register::IR1, psyqo::GTE::Unsafe>(x);
+    psyqo::GTE::write<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>(w);
+    psyqo::GTE::write<psyqo::GTE::Register::IR3, psyqo::GTE::Safe>(y);
+    psyqo::GTE::Kernels::gpf<psyqo::GTE::Kernels::SF::Unshifted>();
+    const std::int32_t xx = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC1, psyqo::GTE::Safe>();
+    const std::int32_t wx = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC2, psyqo::GTE::Unsafe>();
+    const std::int32_t xy = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC3, psyqo::GTE::Unsafe>();
+
+    psyqo::GTE::write<psyqo::GTE::Register::IR0, psyqo::GTE::Unsafe>(y);
+    psyqo::GTE::write<psyqo::GTE::Register::IR1, psyqo::GTE::Unsafe>(y);
+    psyqo::GTE::write<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>(w);
+    psyqo::GTE::write<psyqo::GTE::Register::IR3, psyqo::GTE::Safe>(z);
+    psyqo::GTE::Kernels::gpf<psyqo::GTE::Kernels::SF::Unshifted>();
+    const std::int32_t yy = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC1, psyqo::GTE::Safe>();
+    const std::int32_t wy = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC2, psyqo::GTE::Unsafe>();
+    const std::int32_t yz = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC3, psyqo::GTE::Unsafe>();
+
+    psyqo::GTE::write<psyqo::GTE::Register::IR0, psyqo::GTE::Unsafe>(z);
+    psyqo::GTE::write<psyqo::GTE::Register::IR1, psyqo::GTE::Unsafe>(z);
+    psyqo::GTE::write<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>(w);
+    psyqo::GTE::write<psyqo::GTE::Register::IR3, psyqo::GTE::Safe>(x);
+    psyqo::GTE::Kernels::gpf<psyqo::GTE::Kernels::SF::Unshifted>();
+    const std::int32_t zz = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC1, psyqo::GTE::Safe>();
+    const std::int32_t wz = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC2, psyqo::GTE::Unsafe>();
+    const std::int32_t xz = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC3, psyqo::GTE::Unsafe>();
 
-#define USE_GTE_MATH
+    // 2 * p, 24 fractional bits -> 12
+    const auto twice = [](std::int32_t p) { return (p + (1 << 10)) >> 11; };
+    m[0][0] = 4096 - twice(yy + zz);
+    m[0][1] = twice(xy - wz);
+    m[0][2] = twice(xz + wy);
+    m[1][0] = twice(xy + wz);
+    m[1][1] = 4096 - twice(xx + zz);
+    m[1][2] = twice(yz - wx);
+    m[2][0] = twice(xz - wy);
+    m[2][1] = twice(yz + wx);
+    m[2][2] = 4096 - twice(xx + yy);
+}
+
+void loadParentTransform(std::size_t parent,
+    const PackedJointTransform* packed,
+    const eastl::vector<TransformMatrix>& jointGlobalTransforms)
+{
+    if (parent < MAX_SCRATCHPAD_JOINTS) {
+        const auto& p = packed[parent];
+        psyqo::GTE::write<psyqo::GTE::Register::R11R12, psyqo::GTE::Unsafe>(p.rotation[0]);
+        psyqo::GTE::write<psyqo::GTE::Register::R13R21, psyqo::GTE::Unsafe>(p.rotation[1]);
+        psyqo::GTE::write<psyqo::GTE::Register::R22R23, psyqo::GTE::Unsafe>(p.rotation[2]);
+        psyqo::GTE::write<psyqo::GTE::Register::R31R32, psyqo::GTE::Unsafe>(p.rotation[3]);
+        psyqo::GTE::write<psyqo::GTE::Register::R33, psyqo::GTE::Unsafe>(p.rotation[4]);
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::Translation>(p.translation);
+    } else {
+        const auto& p = jointGlobalTransforms[parent];
+        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::Rotation>(p.rotation);
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::Translation>(p.translation);
+    }
+}
 
-#define TEST
+void storeTransform(std::size_t i,
+    const std::int32_t m[3][3],
+    const psyqo::Vec3& translation,
+    PackedJointTransform* packed,
+    eastl::vector<TransformMatrix>& jointGlobalTransforms)
+{
+    auto& out = jointGlobalTransforms[i];
+    for (int row = 0; row < 3; ++row) {
+        out.rotation.vs[row].x = psyqo::FixedPoint<>(m[row][0], psyqo::FixedPoint<>::RAW);
+        out.rotation.vs[row].y = psyqo::FixedPoint<>(m[row][1], psyqo::FixedPoint<>::RAW);
+        out.rotation.vs[row].z = psyqo::FixedPoint<>(m[row][2], psyqo::FixedPoint<>::RAW);
+    }
+    out.translation = translation;
 
-using namespace psyqo::GTE;
-using namespace psyqo::GTE::Kernels;
+    if (i < MAX_SCRATCHPAD_JOINTS) {
+        auto& p = packed[i];
+        p.rotation[0] = packPair(m[0][0], m[0][1]);
+        p.rotation[1] = packPair(m[0][2], m[1][0]);
+        p.rotation[2] = packPair(m[1][1], m[1][2]);
+        p.rotation[3] = packPair(m[2][0], m[2][1]);
+        p.rotation[4] = (std::uint32_t)m[2][2];
+        p.translation = translation;
+    }
+}
+}
 
+// Same as calling combineTransforms for each joint, but:
+// - local rotations are converted to matrices by GTE
+// - the parent's transform is only loaded into GTE when it changes (siblings share it)
+// - the parent's translation is added by mvmva (it's in the translation register)
 void Armature::calculateTransforms(eastl::vector<TransformMatrix>& jointGlobalTransforms) const
 {
+    auto* packed = (PackedJointTransform*)SCRATCH_PAD;
+    std::int32_t m[3][3];
+
     const auto& rootJoint = getRootJoint();
-    calculateTransforms(jointGlobalTransforms, rootJoint, rootJoint, true);
+    quaternionToMatrix(rootJoint.localTransform.rotation, m);
+    storeTransform(0, m, rootJoint.localTransform.translation, packed, jointGlobalTransforms);
+
+    // parents always go before their children, so their transforms are already calculated
+    std::size_t loadedParent = Joint::NULL_JOINT_ID;
+    std::int32_t local[3][3];
+    for (std::size_t i = 1; i < joints.size(); ++i) {
+        const auto& joint = joints[i];
+        if (joint.parent != loadedParent) {
+            loadParentTransform(joint.parent, packed, jointGlobalTransforms);
+            loadedParent = joint.parent;
+        }
+
+        // R = R_parent * R_local (column by column)
+        quaternionToMatrix(joint.localTransform.rotation, local);
+        for (int col = 0; col < 3; ++col) {
+            psyqo::GTE::write<psyqo::GTE::Register::VXY0, psyqo::GTE::Unsafe>(
+                packPair(local[0][col], local[1][col]));
+            psyqo::GTE::write<psyqo::GTE::Register::VZ0, psyqo::GTE::Safe>(local[2][col]);
+            psyqo::GTE::Kernels::mvmva<psyqo::GTE::Kernels::MX::RT, psyqo::GTE::Kernels::MV::V0>();
+            m[0][col] = (std::int16_t)psyqo::GTE::readRaw<psyqo::GTE::Register::IR1>();
+            m[1][col] = (std::int16_t)psyqo::GTE::readRaw<psyqo::GTE::Register::IR2>();
+            m[2][col] = (std::int16_t)psyqo::GTE::readRaw<psyqo::GTE::Register::IR3>();
+        }
+
+        // T = T_parent + R_parent * T_local
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(joint.localTransform.translation);
+        psyqo::GTE::Kernels::mvmva<psyqo::GTE::Kernels::MX::RT,
+            psyqo::GTE::Kernels::MV::V0,
+            psyqo::GTE::Kernels::TV::TR>();
+        psyqo::Vec3 translation;
+        translation.x.value = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC1>();
+        translation.y.value = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC2>();
+        translation.z.value = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC3>();
+
+        storeTransform(i, m, translation, packed, jointGlobalTransforms);
+    }
 }
 
-void Armature::calculateTransforms(
-    eastl::vector<TransformMatrix>& jointGlobalTransforms,
-    const Joint& joint,
-    const Joint& parentJoint,
-    bool isRoot) const
+void Armature::calculateParents()
 {
-    auto& jointGlobalTransform = jointGlobalTransforms[joint.id];
-    if (isRoot) {
-        jointGlobalTransform.rotation = joint.localTransform.rotation.toRotationMatrix();
-        jointGlobalTransform.translation = joint.localTransform.translation;
-    } else {
-        jointGlobalTransform =
-            combineTransforms(jointGlobalTransforms[parentJoint.id], joint.localTransform);
+    for (auto& joint : joints) {
+        auto childId = joint.firstChild;
+        while (childId != Joint::NULL_JOINT_ID) {
+            auto& child = joints[childId];
+            child.parent = joint.id;
+            childId = child.nextSibling;
+        }
     }
+}
 
-    auto currentJointId = joint.firstChild;
-    while (currentJointId != Joint::NULL_JOINT_ID) {
-        auto& child = joints[currentJointId];
-        calculateTransforms(jointGlobalTransforms, child, joint);
-        currentJointId = child.nextSibling;
+bool Armature::isSorted() const
+{
+    for (std::size_t i = 1; i < joints.size(); ++i) {
+        if (joints[i].parent >= i) {
+            return false;
+        }
     }
+    return true;
 }
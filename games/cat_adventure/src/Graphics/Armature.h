@@ -17,8 +17,10 @@ struct Joint {
     JointId id{NULL_JOINT_ID};
     JointId firstChild{NULL_JOINT_ID};
     JointId nextSibling{NULL_JOINT_ID};
+    JointId parent{NULL_JOINT_ID};
 };
 
+// Joints are stored parent-before-child (joints[i].parent < i), the root is joints[0]
 struct Armature {
     const Joint& getRootJoint() const { return joints[0]; }
     Joint& getRootJoint() { return joints[0]; }
@@ -26,11 +28,10 @@ struct Armature {
     eastl::vector<Joint> joints;
 
     void calculateTransforms(eastl::vector<TransformMatrix>& jointGlobalTransforms) const;
-    void calculateTransforms(
-        eastl::vector<TransformMatrix>& jointGlobalTransforms,
-        const Joint& joint,
-        const Joint& parentJoint,
-        bool isRoot = false) const;
+
+    // Sets parents from firstChild/nextSibling (for old files which don't store them)
+    void calculateParents();
+    bool isSorted() const;
 
     Joint::JointId selectedJoint{0};
 };
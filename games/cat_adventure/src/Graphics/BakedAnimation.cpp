@@ -0,0 +1,71 @@
+#include "BakedAnimation.h"
+
+#include <EASTL/algorithm.h>
+#include <common/syscalls/syscalls.h>
+
+#include <Graphics/Armature.h>
+#include <Graphics/SkeletalAnimation.h>
+
+const BakedAnimation* BakedAnimations::findAnimation(StringHash animationName) const
+{
+    for (const auto& animation : animations) {
+        if (animation.name == animationName) {
+            return &animation;
+        }
+    }
+    return nullptr;
+}
+
+void bakeAnimations(
+    BakedAnimations& baked,
+    const Armature& armature,
+    const eastl::vector<SkeletalAnimation>& animations,
+    std::initializer_list<StringHash> animationNames,
+    std::size_t budget)
+{
+    const auto numJoints = armature.joints.size();
+    eastl::vector<TransformMatrix> pose(numJoints);
+    eastl::vector<TrackCursor> trackCursors;
+
+    for (const auto animationName : animationNames) {
+        const auto it = eastl::find_if(animations.begin(),
+            animations.end(),
+            [animationName](const SkeletalAnimation& a) { return a.name == animationName; });
+        if (it == animations.end()) {
+            ramsyscall_printf("Can't bake %s: animation not found\n", animationName.getStr());
+            continue;
+        }
+        const auto& animation = *it;
+
+        const std::size_t numFrames = animation.length + 1; // both first and last frame
+        const auto size = numFrames * numJoints * sizeof(TransformMatrix);
+        if (baked.memoryUsed + size > budget) {
+            ramsyscall_printf("Can't bake %s: needs %d bytes, %d of %d bytes used\n",
+                animationName.getStr(),
+                (int)size,
+                (int)baked.memoryUsed,
+                (int)budget);
+            continue;
+        }
+
+        BakedAnimation bakedAnimation{
+            .name = animationName,
+            .numFrames = (std::uint16_t)numFrames,
+            .numJoints = (std::uint16_t)numJoints,
+        };
+        bakedAnimation.poses.resize(numFrames * numJoints);
+
+        auto bindPose = armature;
+        trackCursors.clear();
+        for (std::size_t frame = 0; frame < numFrames; ++frame) {
+            const auto normalizedAnimTime =
+                psyqo::FixedPoint<>(frame, 0) / psyqo::FixedPoint<>(animation.length, 0);
+            animateArmature(bindPose, animation, normalizedAnimTime, trackCursors);
+            bindPose.calculateTransforms(pose);
+            eastl::copy(pose.begin(), pose.end(), &bakedAnimation.poses[frame * numJoints]);
+        }
+
+        baked.memoryUsed += size;
+        baked.animations.push_back(eastl::move(bakedAnimation));
+    }
+}
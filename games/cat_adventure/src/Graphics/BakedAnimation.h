@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+
+#include <EASTL/vector.h>
+
+#include <Core/StringHash.h>
+#include <Math/Transform.h>
+
+struct Armature;
+struct SkeletalAnimation;
+
+// Joint global transforms of each frame (at 30 FPS) of an animation, calculated on load.
+// Playing it only copies one pose instead of sampling the tracks and calculating
+// the armature's transforms every frame - good for idle/walk cycles of background NPCs.
+struct BakedAnimation {
+    StringHash name;
+    std::uint16_t numFrames;
+    std::uint16_t numJoints;
+    eastl::vector<TransformMatrix> poses; // numFrames * numJoints
+
+    const TransformMatrix* getPose(int frame) const { return &poses[frame * numJoints]; }
+};
+
+struct BakedAnimations {
+    eastl::vector<BakedAnimation> animations;
+    std::size_t memoryUsed{0}; // in bytes
+
+    const BakedAnimation* findAnimation(StringHash animationName) const;
+};
+
+// Bakes the animations (in the given order) as long as they fit into budget (in bytes),
+// the ones which don't fit are played normally.
+// Each animation is baked starting from the armature's bind pose.
+void bakeAnimations(
+    BakedAnimations& baked,
+    const Armature& armature,
+    const eastl::vector<SkeletalAnimation>& animations,
+    std::initializer_list<StringHash> animationNames,
+    std::size_t budget);
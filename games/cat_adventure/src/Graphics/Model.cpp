@@ -1,9 +1,158 @@
 #include "Model.h"
 
 #include <common/syscalls/syscalls.h>
+#include <psyqo/kernel.hh>
 #include <utility>
 
 #include <Core/FileReader.h>
+#include <Math/Math.h>
+
+namespace
+{
+void readBounds(util::FileReader& fr, MeshBounds& bounds)
+{
+    bounds.min.x.value = fr.GetInt16();
+    bounds.min.y.value = fr.GetInt16();
+    bounds.min.z.value = fr.GetInt16();
+    bounds.max.x.value = fr.GetInt16();
+    bounds.max.y.value = fr.GetInt16();
+    bounds.max.z.value = fr.GetInt16();
+    bounds.center.x.value = fr.GetInt16();
+    bounds.center.y.value = fr.GetInt16();
+    bounds.center.z.value = fr.GetInt16();
+    bounds.radius.value = fr.GetUInt16();
+}
+
+// only needed for old files which don't have bounds stored in them
+MeshBounds calculateBounds(const eastl::vector<Vec3Pad>& vertices)
+{
+    MeshBounds bounds{};
+    if (vertices.empty()) {
+        return bounds;
+    }
+
+    const auto& v0 = vertices[0].pos;
+    bounds.min = {psyqo::FixedPoint<>(v0.x), psyqo::FixedPoint<>(v0.y), psyqo::FixedPoint<>(v0.z)};
+    bounds.max = bounds.min;
+    for (const auto& v : vertices) {
+        bounds.min.x = eastl::min(bounds.min.x, psyqo::FixedPoint<>(v.pos.x));
+        bounds.min.y = eastl::min(bounds.min.y, psyqo::FixedPoint<>(v.pos.y));
+        bounds.min.z = eastl::min(bounds.min.z, psyqo::FixedPoint<>(v.pos.z));
+        bounds.max.x = eastl::max(bounds.max.x, psyqo::FixedPoint<>(v.pos.x));
+        bounds.max.y = eastl::max(bounds.max.y, psyqo::FixedPoint<>(v.pos.y));
+        bounds.max.z = eastl::max(bounds.max.z, psyqo::FixedPoint<>(v.pos.z));
+    }
+
+    bounds.center.x.value = (bounds.min.x.value + bounds.max.x.value) / 2;
+    bounds.center.y.value = (bounds.min.y.value + bounds.max.y.value) / 2;
+    bounds.center.z.value = (bounds.min.z.value + bounds.max.z.value) / 2;
+
+    // squared distances can overflow in 20.12, so calculate them with less precision
+    std::uint32_t maxDistSq = 0;
+    for (const auto& v : vertices) {
+        const auto dx = (psyqo::FixedPoint<>(v.pos.x).value - bounds.center.x.value) >> 2;
+        const auto dy = (psyqo::FixedPoint<>(v.pos.y).value - bounds.center.y.value) >> 2;
+        const auto dz = (psyqo::FixedPoint<>(v.pos.z).value - bounds.center.z.value) >> 2;
+        maxDistSq = eastl::max(maxDistSq, (std::uint32_t)(dx * dx + dy * dy + dz * dz));
+    }
+    bounds.radius.value = (math::isqrt(maxDistSq) + 1) << 2;
+
+    return bounds;
+}
+
+MeshBounds mergeBounds(const eastl::vector<MeshData>& meshes)
+{
+    MeshBounds bounds{};
+    if (meshes.empty()) {
+        return bounds;
+    }
+
+    bounds.min = meshes[0].bounds.min;
+    bounds.max = meshes[0].bounds.max;
+    for (const auto& mesh : meshes) {
+        const auto& mb = mesh.bounds;
+        bounds.min.x = eastl::min(bounds.min.x, mb.min.x);
+        bounds.min.y = eastl::min(bounds.min.y, mb.min.y);
+        bounds.min.z = eastl::min(bounds.min.z, mb.min.z);
+        bounds.max.x = eastl::max(bounds.max.x, mb.max.x);
+        bounds.max.y = eastl::max(bounds.max.y, mb.max.y);
+        bounds.max.z = eastl::max(bounds.max.z, mb.max.z);
+    }
+
+    bounds.center.x.value = (bounds.min.x.value + bounds.max.x.value) / 2;
+    bounds.center.y.value = (bounds.min.y.value + bounds.max.y.value) / 2;
+    bounds.center.z.value = (bounds.min.z.value + bounds.max.z.value) / 2;
+
+    // sphere which contains all submesh spheres
+    std::int32_t radius = 0;
+    for (const auto& mesh : meshes) {
+        const auto& mb = mesh.bounds;
+        const auto dx = (mb.center.x.value - bounds.center.x.value) >> 2;
+        const auto dy = (mb.center.y.value - bounds.center.y.value) >> 2;
+        const auto dz = (mb.center.z.value - bounds.center.z.value) >> 2;
+        const auto dist = ((std::int32_t)math::isqrt(dx * dx + dy * dy + dz * dz) + 1) << 2;
+        radius = eastl::max(radius, dist + mb.radius.value);
+    }
+    bounds.radius.value = radius;
+
+    return bounds;
+}
+
+void readMesh(util::FileReader& fr, MeshData& mesh, bool indexedVertices, bool hasBounds)
+{
+    mesh.jointId = fr.GetUInt16();
+    mesh.numUntexturedTris = fr.GetUInt16();
+    mesh.numUntexturedQuads = fr.GetUInt16();
+    mesh.numTris = fr.GetUInt16();
+    mesh.numQuads = fr.GetUInt16();
+
+    if (hasBounds) {
+        readBounds(fr, mesh.bounds);
+    }
+
+    const auto numIndices = mesh.numUntexturedTris * 3 + mesh.numUntexturedQuads * 4 +
+                            mesh.numTris * 3 + mesh.numQuads * 4;
+    mesh.indices.resize(numIndices);
+    if (indexedVertices) {
+        const auto numVertices = fr.GetUInt16();
+        mesh.vertices.resize(numVertices);
+        fr.ReadArr(mesh.vertices.data(), numVertices);
+
+        if (numVertices <= 256) { // 8-bit indices
+            for (int j = 0; j < numIndices; ++j) {
+                mesh.indices[j] = fr.GetUInt8();
+            }
+            if (numIndices % 2 != 0) {
+                fr.SkipBytes(1); // pad
+            }
+        } else {
+            fr.ReadArr(mesh.indices.data(), numIndices);
+        }
+    } else { // old format - each face has its own vertices
+        mesh.vertices.resize(numIndices);
+        fr.ReadArr(mesh.vertices.data(), numIndices);
+        for (int j = 0; j < numIndices; ++j) {
+            mesh.indices[j] = j;
+        }
+    }
+
+    if (!hasBounds) {
+        mesh.bounds = calculateBounds(mesh.vertices);
+    }
+
+    mesh.g3.resize(mesh.numUntexturedTris);
+    fr.ReadArr(mesh.g3.data(), mesh.numUntexturedTris);
+
+    mesh.g4.resize(mesh.numUntexturedQuads);
+    fr.ReadArr(mesh.g4.data(), mesh.numUntexturedQuads);
+
+    mesh.gt3.resize(mesh.numTris);
+    fr.ReadArr(mesh.gt3.data(), mesh.numTris);
+
+    mesh.gt4.resize(mesh.numQuads);
+    fr.ReadArr(mesh.gt4.data(), mesh.numQuads);
+}
+}
 
 void ModelData::load(const eastl::vector<uint8_t>& data)
 {
@@ -15,39 +164,53 @@ void ModelData::load(const eastl::vector<uint8_t>& data)
 
 void ModelData::load(util::FileReader& fr)
 {
+    // ModelData can be loaded again (e.g. level's tile meshes on level switch)
+    meshes.clear();
+    lodMeshes.clear();
+    armature.joints.clear();
+    bounds = {};
+
     const auto flags = fr.GetUInt16();
     bool hasArmature = ((flags & 1) != 0);
+    bool indexedVertices = ((flags & 2) != 0);
+    bool hasBounds = ((flags & 4) != 0);
+    bool hasLods = ((flags & 8) != 0);
+    bool hasJointParents = ((flags & 16) != 0);
 
     const auto numSubmeshes = fr.GetUInt16();
     meshes.reserve(numSubmeshes);
 
+    if (hasBounds) {
+        readBounds(fr, bounds);
+    }
+
     for (int i = 0; i < numSubmeshes; ++i) {
         MeshData mesh;
+        readMesh(fr, mesh, indexedVertices, hasBounds);
 
-        mesh.jointId = fr.GetUInt16();
-        mesh.numUntexturedTris = fr.GetUInt16();
-        mesh.numUntexturedQuads = fr.GetUInt16();
-        mesh.numTris = fr.GetUInt16();
-        mesh.numQuads = fr.GetUInt16();
-
-        const auto numVertices = mesh.numUntexturedTris * 3 + mesh.numUntexturedQuads * 4 +
-                                 mesh.numTris * 3 + mesh.numQuads * 4;
-        mesh.vertices.resize(numVertices);
-        fr.ReadArr(mesh.vertices.data(), numVertices);
-
-        mesh.g3.resize(mesh.numUntexturedTris);
-        fr.ReadArr(mesh.g3.data(), mesh.numUntexturedTris);
-
-        mesh.g4.resize(mesh.numUntexturedQuads);
-        fr.ReadArr(mesh.g4.data(), mesh.numUntexturedQuads);
+        if (hasLods) {
+            mesh.numLods = fr.GetUInt16();
+            for (int j = 0; j < mesh.numLods; ++j) {
+                mesh.lods[j].distance.value = fr.GetUInt16();
+                MeshData lodMesh;
+                readMesh(fr, lodMesh, indexedVertices, hasBounds);
+                lodMeshes.push_back(std::move(lodMesh));
+            }
+        }
 
-        mesh.gt3.resize(mesh.numTris);
-        fr.ReadArr(mesh.gt3.data(), mesh.numTris);
+        meshes.push_back(std::move(mesh));
+    }
 
-        mesh.gt4.resize(mesh.numQuads);
-        fr.ReadArr(mesh.gt4.data(), mesh.numQuads);
+    // lodMeshes won't be reallocated anymore
+    std::size_t lodIndex = 0;
+    for (auto& mesh : meshes) {
+        for (int j = 0; j < mesh.numLods; ++j) {
+            mesh.lods[j].meshData = &lodMeshes[lodIndex++];
+        }
+    }
 
-        meshes.push_back(std::move(mesh));
+    if (!hasBounds) {
+        bounds = mergeBounds(meshes);
     }
 
     if (hasArmature) {
@@ -71,7 +234,16 @@ void ModelData::load(util::FileReader& fr)
 
             joint.firstChild = fr.GetUInt8();
             joint.nextSibling = fr.GetUInt8();
+            if (hasJointParents) {
+                joint.parent = fr.GetUInt8();
+                fr.SkipBytes(1); // pad
+            }
+        }
+
+        if (!hasJointParents) {
+            armature.calculateParents();
         }
+        psyqo::Kernel::assert(armature.isSorted(), "Armature joints are not sorted");
     }
 }
 
@@ -82,11 +254,54 @@ Mesh MeshData::makeInstance() const
     };
 }
 
+void Mesh::initPackets()
+{
+    const auto& gt3s = meshData->gt3;
+    const auto& gt4s = meshData->gt4;
+
+    for (auto& p : packets) {
+        p.gt3.resize(gt3s.size());
+        p.gt3Fog.resize(gt3s.size());
+        for (std::size_t i = 0; i < gt3s.size(); ++i) {
+            const auto& prim = gt3s[i];
+            auto& triT = p.gt3[i].primitive;
+            triT.tpage = prim.tpage;
+            triT.clutIndex = prim.clutIndex;
+            triT.uvA = prim.uvA;
+            triT.uvB = prim.uvB;
+            triT.uvC = prim.uvC; // also copies additional bias
+            triT.setColorA(prim.getColorA());
+            triT.setColorB(prim.getColorB());
+            triT.setColorC(prim.getColorC());
+        }
+
+        p.gt4.resize(gt4s.size());
+        p.gt4Fog.resize(gt4s.size());
+        for (std::size_t i = 0; i < gt4s.size(); ++i) {
+            const auto& prim = gt4s[i];
+            auto& quadT = p.gt4[i].primitive;
+            quadT.tpage = prim.tpage;
+            quadT.clutIndex = prim.clutIndex;
+            quadT.uvA = prim.uvA;
+            quadT.uvB = prim.uvB;
+            quadT.uvC = prim.uvC; // also copies additional bias
+            quadT.uvD = prim.uvD;
+            quadT.setColorA(prim.getColorA());
+            quadT.setColorB(prim.getColorB());
+            quadT.setColorC(prim.getColorC());
+            quadT.setColorD(prim.getColorD());
+        }
+
+        p.fogMode = false;
+    }
+}
+
 Model ModelData::makeInstance() const
 {
     Model instance{};
 
     instance.armature = armature;
+    instance.bounds = bounds;
     instance.meshes.reserve(meshes.size());
     for (const auto& mesh : meshes) {
         instance.meshes.push_back(mesh.makeInstance());
@@ -6,6 +6,7 @@
 using ssize_t = std::int32_t; // TODO: remove after updating psyqo
 #include <EASTL/variant.h>
 
+#include <EASTL/array.h>
 #include <EASTL/string_view.h>
 #include <EASTL/vector.h>
 
@@ -31,7 +32,25 @@ struct FileReader;
 template<typename PrimType>
 using FragData = eastl::vector<PrimType>;
 
+// Bounding volumes in mesh/model space (used for frustum culling)
+struct MeshBounds {
+    psyqo::Vec3 min;
+    psyqo::Vec3 max;
+    psyqo::Vec3 center;
+    psyqo::FixedPoint<> radius;
+};
+
 struct Mesh;
+struct MeshData;
+
+// max number of less detailed versions of a mesh
+inline constexpr int MAX_MESH_LODS = 2;
+
+struct MeshLod {
+    const MeshData* meshData{nullptr};
+    // view space distance starting from which the LOD is drawn
+    psyqo::FixedPoint<> distance;
+};
 
 struct MeshData {
     int numUntexturedTris{0};
@@ -40,25 +59,72 @@ struct MeshData {
     int numQuads{0};
     std::uint16_t jointId;
 
+    // in joint space for skinned meshes
+    MeshBounds bounds;
+
+    // unique vertices (each one is transformed once per draw)
     eastl::vector<Vec3Pad> vertices;
+    // 3 or 4 indices per face, in g3, g4, gt3, gt4 order
+    eastl::vector<std::uint16_t> indices;
 
     FragData<psyqo::Prim::GouraudTriangle> g3;
     FragData<psyqo::Prim::GouraudQuad> g4;
     FragData<psyqo::Prim::GouraudTexturedTriangle> gt3;
     FragData<psyqo::Prim::GouraudTexturedQuad> gt4;
 
+    // from the most to the least detailed (point into ModelData::lodMeshes)
+    eastl::array<MeshLod, MAX_MESH_LODS> lods;
+    int numLods{0};
+
     Mesh makeInstance() const;
 };
 
+// GPU packets which are kept between frames (see Mesh::initPackets)
+struct MeshPackets {
+    template<typename PrimType>
+    using FragArray = eastl::vector<psyqo::Fragments::SimpleFragment<PrimType>>;
+
+    FragArray<psyqo::Prim::GouraudTexturedTriangle> gt3;
+    FragArray<psyqo::Prim::GouraudTexturedQuad> gt4;
+
+    // fog overlays (drawn under gt3/gt4 when fog is enabled)
+    FragArray<psyqo::Prim::GouraudTriangle> gt3Fog;
+    FragArray<psyqo::Prim::GouraudQuad> gt4Fog;
+
+    // true if semi-trans flags are set up for drawing with fog
+    bool fogMode{false};
+};
+
 struct Mesh {
     const MeshData* meshData{nullptr};
+
+    // Static meshes build their packets once on level load.
+    // tpage, clut and UVs never change, so only screen coords, colors and OT links
+    // are written during drawing.
+    // There are two copies - one is being read by GPU while we write into another one.
+    eastl::array<MeshPackets, 2> packets;
+
+    // LOD which was drawn last time (0 - meshData itself, i - meshData->lods[i - 1])
+    int lod{0};
+
+    void initPackets();
 };
 
 struct Model;
 
 struct ModelData {
+    ModelData() = default;
+    // MeshData::lods and mesh instances point into meshes/lodMeshes, so copies would dangle.
+    // Moving is fine: vectors keep their buffers.
+    ModelData(const ModelData&) = delete;
+    ModelData& operator=(const ModelData&) = delete;
+    ModelData(ModelData&&) = default;
+    ModelData& operator=(ModelData&&) = default;
+
     eastl::vector<MeshData> meshes;
+    eastl::vector<MeshData> lodMeshes;
     Armature armature;
+    MeshBounds bounds; // only valid for models without armature
 
     void load(const eastl::vector<uint8_t>& data);
     void load(util::FileReader& fr);
@@ -69,6 +135,7 @@ struct ModelData {
 struct Model {
     eastl::vector<Mesh> meshes;
     Armature armature;
+    MeshBounds bounds;
 
     void load(const eastl::vector<uint8_t>& data);
 };
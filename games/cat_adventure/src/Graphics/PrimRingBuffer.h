@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <EASTL/algorithm.h>
+#include <EASTL/array.h>
+#include <EASTL/type_traits.h>
+#include <EASTL/utility.h>
+
+#include <psyqo/fragments.hh>
+#include <psyqo/kernel.hh>
+#include <psyqo/primitives/lines.hh>
+#include <psyqo/primitives/quads.hh>
+#include <psyqo/primitives/sprites.hh>
+#include <psyqo/primitives/triangles.hh>
+
+// Primitive types which PrimRingBuffer counts allocated bytes for
+enum class PrimStatsType : std::uint8_t {
+    GouraudTriangle,
+    GouraudQuad,
+    GouraudTexturedTriangle,
+    GouraudTexturedQuad,
+    Sprite,
+    Line,
+    Other,
+
+    Count,
+};
+
+template<typename P>
+constexpr PrimStatsType getPrimStatsType()
+{
+    if constexpr (eastl::is_same_v<P, psyqo::Prim::GouraudTriangle>) {
+        return PrimStatsType::GouraudTriangle;
+    } else if constexpr (eastl::is_same_v<P, psyqo::Prim::GouraudQuad>) {
+        return PrimStatsType::GouraudQuad;
+    } else if constexpr (eastl::is_same_v<P, psyqo::Prim::GouraudTexturedTriangle>) {
+        return PrimStatsType::GouraudTexturedTriangle;
+    } else if constexpr (eastl::is_same_v<P, psyqo::Prim::GouraudTexturedQuad>) {
+        return PrimStatsType::GouraudTexturedQuad;
+    } else if constexpr (eastl::is_same_v<P, psyqo::Prim::Sprite>) {
+        return PrimStatsType::Sprite;
+    } else if constexpr (eastl::is_same_v<P, psyqo::Prim::Line>) {
+        return PrimStatsType::Line;
+    } else {
+        return PrimStatsType::Other;
+    }
+}
+
+// Primitive allocator shared by all frames (has the same interface as psyqo::BumpAllocator).
+// The GPU draws the previous frame's chain while the current one is being built, so
+// instead of two buffers (one per parity, each of them sized for the worst frame) there's
+// one ring: each frame allocates right after the previous one, and the previous
+// frame's space is reclaimed as soon as the GPU has consumed its chain.
+template<std::size_t N>
+class PrimRingBuffer {
+    // head/tail/frameStart are never wrapped: they're positions in an infinite stream of
+    // bytes and (pos % N) is the offset in the buffer. This also works when they overflow.
+    static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    // Must be called before anything is allocated for the frame.
+    // prevFrameConsumed - whether the GPU has finished transferring the previous frame's chain
+    // (the frame before it is always done by then - flip waits for it)
+    void beginFrame(bool prevFrameConsumed)
+    {
+        tail = prevFrameConsumed ? head : frameStart;
+        frameStart = head;
+        bytesByType = {};
+    }
+
+    template<typename P, typename... Args>
+    psyqo::Fragments::SimpleFragment<P>& allocateFragment(Args&&... args)
+    {
+        using FragmentType = psyqo::Fragments::SimpleFragment<P>;
+        bytesByType[(std::size_t)getPrimStatsType<P>()] += getAllocSize<FragmentType>();
+        return allocate<FragmentType>(eastl::forward<Args>(args)...);
+    }
+
+    template<typename T, typename... Args>
+    T& allocate(Args&&... args)
+    {
+        return *new (allocateBytes(getAllocSize<T>())) T(eastl::forward<Args>(args)...);
+    }
+
+    // Same as allocateFragment, but returns nullptr instead of running out of memory.
+    // reserve - how many bytes should stay free for the primitives which can't be skipped
+    template<typename P, typename... Args>
+    psyqo::Fragments::SimpleFragment<P>* tryAllocateFragment(std::size_t reserve, Args&&... args)
+    {
+        if (!hasSpace(getAllocSize<psyqo::Fragments::SimpleFragment<P>>(), reserve)) {
+            return nullptr;
+        }
+        return &allocateFragment<P>(eastl::forward<Args>(args)...);
+    }
+
+    // Whether size bytes can be allocated with reserve bytes left free after that.
+    // Conservative: assumes that all of them are allocated as one block.
+    bool hasSpace(std::size_t size, std::size_t reserve = 0) const
+    {
+        const auto offset = head % N;
+        const auto skipped = (offset + size > N) ? N - offset : 0;
+        return remaining() >= skipped + size + reserve;
+    }
+
+    // bytes allocated during the current frame
+    std::size_t used() const { return head - frameStart; }
+    // bytes which can still be allocated during the current frame
+    std::size_t remaining() const { return N - (head - tail); }
+
+    // bytes allocated with allocateFragment during the current frame
+    const eastl::array<std::uint32_t, (std::size_t)PrimStatsType::Count>& getBytesByType() const
+    {
+        return bytesByType;
+    }
+
+    // max bytes allocated during one frame
+    std::size_t getPeakFrameUsage() const { return peakFrameUsage; }
+    // max bytes in use at once (current frame + previous frame if it wasn't consumed yet)
+    std::size_t getPeakUsage() const { return peakUsage; }
+
+private:
+    template<typename T>
+    static constexpr std::uint32_t getAllocSize()
+    {
+        return (sizeof(T) + 3) & ~3;
+    }
+
+    void* allocateBytes(std::uint32_t size)
+    {
+        auto offset = head % N;
+        if (offset + size > N) {
+            // primitives can't be split, skip the end of the buffer
+            head += N - offset;
+            offset = 0;
+        }
+        head += size;
+        psyqo::Kernel::assert(head - tail <= N, "PrimRingBuffer: out of memory");
+
+        peakFrameUsage = eastl::max(peakFrameUsage, (std::size_t)(head - frameStart));
+        peakUsage = eastl::max(peakUsage, (std::size_t)(head - tail));
+
+        return &memory[offset];
+    }
+
+    alignas(4) std::uint8_t memory[N];
+    std::uint32_t head{0};
+    std::uint32_t tail{0}; // start of the memory which the GPU can still read
+    std::uint32_t frameStart{0};
+
+    std::size_t peakFrameUsage{0};
+    std::size_t peakUsage{0};
+
+    eastl::array<std::uint32_t, (std::size_t)PrimStatsType::Count> bytesByType{};
+};
@@ -1,5 +1,7 @@
 #include "Renderer.h"
 
+#include <EASTL/type_traits.h>
+
 #include <common/syscalls/syscalls.h>
 #include <psyqo/primitives/lines.hh>
 #include <psyqo/primitives/rectangles.hh>
@@ -18,7 +20,10 @@
 #include "Subdivision.h"
 
 static constexpr auto textureNeutral = psyqo::Color{.r = 128, .g = 128, .b = 128};
-static constexpr auto floorBias = 500;
+
+// transformed vertices are stored after subdivision data in the scratchpad
+static constexpr auto scratchPadVertexCacheSize =
+    (SCRATCH_PAD_SIZE - sizeof(SubdivData)) / sizeof(Renderer::TransformedVertex);
 
 namespace
 {
@@ -28,6 +33,13 @@ int16_t getAddBias(const T& prim)
     return prim.uvC.user;
 }
 
+Renderer::DepthLayer getTileLayer(const TileInfo& tileInfo)
+{
+    // Roads/pavements are stored with negative height (they're a bit below the grass around them),
+    // they go to a layer behind the rest of the floor so that their edges don't z-fight with it
+    return tileInfo.height.value < 0 ? Renderer::DepthLayer::FloorLow : Renderer::DepthLayer::Floor;
+}
+
 static constexpr psyqo::FixedPoint<> toWorldCoords(std::uint16_t idx)
 {
     // only for Tile::SIZE == 8!!!
@@ -35,14 +47,6 @@ static constexpr psyqo::FixedPoint<> toWorldCoords(std::uint16_t idx)
     return psyqo::FixedPoint<>(idx << 9, psyqo::FixedPoint<>::RAW);
 }
 
-// Interpolate color immediately after doing rtps (IR0 has "p" in it already)
-psyqo::Color interpColorImm(psyqo::Color input)
-{
-    psyqo::GTE::write<psyqo::GTE::Register::RGB, psyqo::GTE::Safe>(input.packed);
-    psyqo::GTE::Kernels::dpcs();
-    return {.packed = psyqo::GTE::readRaw<psyqo::GTE::Register::RGB2>()};
-}
-
 // Interpolate from input to fc
 // (0 = input, 1 = fc)
 psyqo::Color interpColor(psyqo::Color input, uint32_t p)
@@ -63,41 +67,273 @@ psyqo::Color interpColorBack(psyqo::Color input, uint32_t p)
     return {.packed = psyqo::GTE::readRaw<psyqo::GTE::Register::RGB2>()};
 }
 
+// Static mesh packets are drawn semi-trans with a fog overlay under them when fog is enabled
+// and with the original vertex colors otherwise. Switching between these modes is rare
+// (only happens when fog is toggled), so it's not done every frame.
+void setPacketsFogMode(MeshPackets& packets, const MeshData& meshData, bool fog)
+{
+    for (std::size_t i = 0; i < packets.gt3.size(); ++i) {
+        auto& triT = packets.gt3[i].primitive;
+        if (fog) {
+            triT.setSemiTrans();
+        } else {
+            const auto& prim = meshData.gt3[i];
+            triT.setOpaque();
+            triT.setColorA(prim.getColorA());
+            triT.setColorB(prim.getColorB());
+            triT.setColorC(prim.getColorC());
+        }
+    }
+
+    for (std::size_t i = 0; i < packets.gt4.size(); ++i) {
+        auto& quadT = packets.gt4[i].primitive;
+        if (fog) {
+            if (getAddBias(quadT) == 3) { // textures with alpha
+                quadT.setOpaque();
+                packets.gt4Fog[i].primitive.setSemiTrans();
+            } else {
+                quadT.setSemiTrans();
+            }
+        } else {
+            const auto& prim = meshData.gt4[i];
+            quadT.setOpaque();
+            quadT.setColorA(prim.getColorA());
+            quadT.setColorB(prim.getColorB());
+            quadT.setColorC(prim.getColorC());
+            quadT.setColorD(prim.getColorD());
+        }
+    }
+
+    packets.fogMode = fog;
+}
+
+// Load cached screen coords and depths into GTE, so that nclip and avsz3 can be used
+void loadTriangle(const Renderer::TransformedVertex& a,
+    const Renderer::TransformedVertex& b,
+    const Renderer::TransformedVertex& c)
+{
+    psyqo::GTE::write<psyqo::GTE::Register::SXY0, psyqo::GTE::Unsafe>(a.sxy);
+    psyqo::GTE::write<psyqo::GTE::Register::SXY1, psyqo::GTE::Unsafe>(b.sxy);
+    psyqo::GTE::write<psyqo::GTE::Register::SXY2, psyqo::GTE::Unsafe>(c.sxy);
+    psyqo::GTE::write<psyqo::GTE::Register::SZ1, psyqo::GTE::Unsafe>(a.sz);
+    psyqo::GTE::write<psyqo::GTE::Register::SZ2, psyqo::GTE::Unsafe>(b.sz);
+    psyqo::GTE::write<psyqo::GTE::Register::SZ3, psyqo::GTE::Safe>(c.sz);
+}
+
+// Same as loadTriangle, but for nclip and avsz4
+void loadQuad(const Renderer::TransformedVertex& a,
+    const Renderer::TransformedVertex& b,
+    const Renderer::TransformedVertex& c,
+    const Renderer::TransformedVertex& d)
+{
+    psyqo::GTE::write<psyqo::GTE::Register::SXY0, psyqo::GTE::Unsafe>(a.sxy);
+    psyqo::GTE::write<psyqo::GTE::Register::SXY1, psyqo::GTE::Unsafe>(b.sxy);
+    psyqo::GTE::write<psyqo::GTE::Register::SXY2, psyqo::GTE::Unsafe>(c.sxy);
+    psyqo::GTE::write<psyqo::GTE::Register::SZ0, psyqo::GTE::Unsafe>(a.sz);
+    psyqo::GTE::write<psyqo::GTE::Register::SZ1, psyqo::GTE::Unsafe>(b.sz);
+    psyqo::GTE::write<psyqo::GTE::Register::SZ2, psyqo::GTE::Unsafe>(c.sz);
+    psyqo::GTE::write<psyqo::GTE::Register::SZ3, psyqo::GTE::Safe>(d.sz);
+}
+
+template<typename PrimType>
+constexpr bool isQuadPrim = eastl::is_same_v<PrimType, psyqo::Prim::GouraudQuad> ||
+                            eastl::is_same_v<PrimType, psyqo::Prim::GouraudTexturedQuad>;
+
+// v3 is ignored for triangles
+template<typename PrimType>
+void setPrimPoints(PrimType& prim,
+    const Renderer::TransformedVertex& v0,
+    const Renderer::TransformedVertex& v1,
+    const Renderer::TransformedVertex& v2,
+    const Renderer::TransformedVertex& v3)
+{
+    prim.pointA.packed = v0.sxy;
+    prim.pointB.packed = v1.sxy;
+    prim.pointC.packed = v2.sxy;
+    if constexpr (isQuadPrim<PrimType>) {
+        prim.pointD.packed = v3.sxy;
+    }
+}
+
+template<typename PrimType>
+void setPrimColors(PrimType& prim, psyqo::Color c)
+{
+    prim.setColorA(c);
+    prim.setColorB(c);
+    prim.setColorC(c);
+    if constexpr (isQuadPrim<PrimType>) {
+        prim.setColorD(c);
+    }
+}
+
+template<typename PrimType>
+void copyPrimColors(PrimType& prim, const PrimType& src)
+{
+    prim.setColorA(src.getColorA());
+    prim.setColorB(src.getColorB());
+    prim.setColorC(src.getColorC());
+    if constexpr (isQuadPrim<PrimType>) {
+        prim.setColorD(src.getColorD());
+    }
+}
+
+// Sets the colors interpolated to the far color by the corners' depth cue factors
+template<typename PrimType>
+void interpPrimColors(PrimType& prim,
+    psyqo::Color c,
+    const Renderer::TransformedVertex& v0,
+    const Renderer::TransformedVertex& v1,
+    const Renderer::TransformedVertex& v2,
+    const Renderer::TransformedVertex& v3)
+{
+    prim.setColorA(interpColor(c, v0.p));
+    prim.setColorB(interpColor(c, v1.p));
+    prim.setColorC(interpColor(c, v2.p));
+    if constexpr (isQuadPrim<PrimType>) {
+        prim.setColorD(interpColor(c, v3.p));
+    }
+}
+
+// Same as above, but interpolates the colors of src
+template<typename PrimType>
+void interpPrimColors(PrimType& prim,
+    const PrimType& src,
+    const Renderer::TransformedVertex& v0,
+    const Renderer::TransformedVertex& v1,
+    const Renderer::TransformedVertex& v2,
+    const Renderer::TransformedVertex& v3)
+{
+    prim.setColorA(interpColor(src.getColorA(), v0.p));
+    prim.setColorB(interpColor(src.getColorB(), v1.p));
+    prim.setColorC(interpColor(src.getColorC(), v2.p));
+    if constexpr (isQuadPrim<PrimType>) {
+        prim.setColorD(interpColor(src.getColorD(), v3.p));
+    }
+}
+
+// Copies tpage, clut and UVs (also copies additional bias stored in uvC's padding)
+void copyTexturedPrimAttrs(psyqo::Prim::GouraudTexturedTriangle& prim,
+    const psyqo::Prim::GouraudTexturedTriangle& src)
+{
+    prim.tpage = src.tpage;
+    prim.clutIndex = src.clutIndex;
+    prim.uvA = src.uvA;
+    prim.uvB = src.uvB;
+    prim.uvC = src.uvC;
+}
+
+void copyTexturedPrimAttrs(psyqo::Prim::GouraudTexturedQuad& prim,
+    const psyqo::Prim::GouraudTexturedQuad& src)
+{
+    prim.tpage = src.tpage;
+    prim.clutIndex = src.clutIndex;
+    prim.uvA = src.uvA;
+    prim.uvB = src.uvB;
+    prim.uvC = src.uvC;
+    prim.uvD = src.uvD;
+}
+
 /* Adopted from https://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/ */
 int orient2d(int ax, int ay, int bx, int by, int cx, int cy)
 {
     return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
 }
 
-void rasterizeTriangle(eastl::bitset<Renderer::MAX_TILES_DIM * Renderer::MAX_TILES_DIM>& tileSeen,
-    int x1,
-    int y1,
-    int x2,
-    int y2,
-    int x3,
-    int y3)
-{
-    int minX = eastl::min({x1, x2, x3});
-    int maxX = eastl::max({x1, x2, x3});
-    int minY = eastl::min({y1, y2, y3});
-    int maxY = eastl::max({y1, y2, y3});
-
-    minX = eastl::max(0, minX);
-    maxX = eastl::min(Renderer::MAX_TILES_DIM - 1, maxX);
-    minY = eastl::max(0, minY);
-    maxY = eastl::min(Renderer::MAX_TILES_DIM - 1, maxY);
-
-    for (int y = minY; y <= maxY; ++y) {
-        for (int x = minX; x <= maxX; ++x) {
-            int w0 = orient2d(x2, y2, x3, y3, x, y);
-            int w1 = orient2d(x3, y3, x1, y1, x, y);
-            int w2 = orient2d(x1, y1, x2, y2, x, y);
-
-            if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-                tileSeen[y * Renderer::MAX_TILES_DIM + x] = 1;
+// Tile visibility is calculated in local coordinates relative to the camera's tile.
+// Each tile is SUBTILE_SIZE units long, so that the view polygon has sub-tile precision.
+static constexpr int SUBTILE_SHIFT = 4;
+static constexpr int SUBTILE_SIZE = 1 << SUBTILE_SHIFT;
+
+struct TilePoint {
+    int x, z;
+};
+
+// Convex hull (Andrew's monotone chain), the result is counter-clockwise
+// Returns the number of points in the hull
+int convexHull(TilePoint* points, int numPoints, TilePoint* hull)
+{
+    eastl::sort(points, points + numPoints, [](const TilePoint& a, const TilePoint& b) {
+        return a.x < b.x || (a.x == b.x && a.z < b.z);
+    });
+
+    int k = 0;
+    for (int i = 0; i < numPoints; ++i) { // lower hull
+        while (k >= 2 && orient2d(hull[k - 2].x,
+                             hull[k - 2].z,
+                             hull[k - 1].x,
+                             hull[k - 1].z,
+                             points[i].x,
+                             points[i].z) <= 0) {
+            --k;
+        }
+        hull[k++] = points[i];
+    }
+
+    for (int i = numPoints - 2, t = k + 1; i >= 0; --i) { // upper hull
+        while (k >= t && orient2d(hull[k - 2].x,
+                             hull[k - 2].z,
+                             hull[k - 1].x,
+                             hull[k - 1].z,
+                             points[i].x,
+                             points[i].z) <= 0) {
+            --k;
+        }
+        hull[k++] = points[i];
+    }
+
+    return eastl::max(k - 1, 0); // last point == first point
+}
+
+// Half-plane of the view polygon: a * x + b * z + c >= 0 is inside
+struct TileEdge {
+    int a, b, c;
+
+    // a * x + b * z + c is linear, so its maximum over the square with the min corner at (x, z)
+    // is at one of its corners. This lets the tests be conservative:
+    // the square is only outside if it's fully outside.
+    int maxOverSquare(int x, int z, int size) const
+    {
+        return a * x + b * z + c + (eastl::max(a, 0) + eastl::max(b, 0)) * size;
+    }
+};
+
+TileEdge makeTileEdge(const TilePoint& p, const TilePoint& q)
+{
+    const int a = -(q.z - p.z);
+    const int b = q.x - p.x;
+    return {.a = a, .b = b, .c = -(a * p.x + b * p.z)};
+}
+
+// Rasterize the polygon into a tile chunk: bit x of rows[z] is set if tile
+// (chunkMinX + x, chunkMinZ + z) overlaps the polygon (coords are relative to the camera's tile)
+// Returns false if no tiles were set.
+bool rasterizeTilePolygon(eastl::array<std::uint16_t, TileMap::CHUNK_SIZE>& rows,
+    int chunkMinX,
+    int chunkMinZ,
+    const TileEdge* edges,
+    int numEdges)
+{
+    static_assert(TileMap::CHUNK_SIZE <= 16, "rows don't fit into std::uint16_t");
+
+    bool anySet = false;
+    for (int z = 0; z < TileMap::CHUNK_SIZE; ++z) {
+        std::uint16_t row = 0;
+        for (int x = 0; x < TileMap::CHUNK_SIZE; ++x) {
+            const int sx = (chunkMinX + x) << SUBTILE_SHIFT;
+            const int sz = (chunkMinZ + z) << SUBTILE_SHIFT;
+            bool inside = true;
+            for (int i = 0; i < numEdges && inside; ++i) {
+                inside = edges[i].maxOverSquare(sx, sz, SUBTILE_SIZE) >= 0;
+            }
+            if (inside) {
+                row |= (1 << x);
             }
         }
+        rows[z] = row;
+        anySet = anySet || (row != 0);
     }
+
+    return anySet;
 }
 
 }
@@ -117,9 +353,38 @@ void Renderer::init()
     setFOV(250);
     // setFOV(350);
 
-    // FIXME: use OT_SIZE here somehow?
-    psyqo::GTE::write<psyqo::GTE::Register::ZSF3, psyqo::GTE::Unsafe>(1024 / 3);
-    psyqo::GTE::write<psyqo::GTE::Register::ZSF4, psyqo::GTE::Unsafe>(1024 / 4);
+    updateDepthMapping();
+}
+
+void Renderer::beginFrame()
+{
+    frameStats.primBytes = primBuffer.getBytesByType();
+    frameStats.primBufferUsed = primBuffer.used();
+
+    auto& peak = peakFrameStats;
+    for (std::size_t i = 0; i < frameStats.primBytes.size(); ++i) {
+        peak.primBytes[i] = eastl::max(peak.primBytes[i], frameStats.primBytes[i]);
+    }
+    peak.primBufferUsed = eastl::max(peak.primBufferUsed, frameStats.primBufferUsed);
+    peak.numPrimsInserted = eastl::max(peak.numPrimsInserted, frameStats.numPrimsInserted);
+    peak.numCulledNclip = eastl::max(peak.numCulledNclip, frameStats.numCulledNclip);
+    peak.numCulledDepth = eastl::max(peak.numCulledDepth, frameStats.numCulledDepth);
+    peak.numPrimsSkipped = eastl::max(peak.numPrimsSkipped, frameStats.numPrimsSkipped);
+    peak.numLateFarPrims = eastl::max(peak.numLateFarPrims, frameStats.numLateFarPrims);
+    peak.minOTZ = eastl::min(peak.minOTZ, frameStats.minOTZ);
+    peak.maxOTZ = eastl::max(peak.maxOTZ, frameStats.maxOTZ);
+
+    lastFrameStats = frameStats;
+    frameStats = {};
+
+    primBuffer.beginFrame(gpu.isChainIdle());
+    farPassChained = false;
+}
+
+void Renderer::chainFarPass()
+{
+    gpu.chain(getFarOrderingTable());
+    farPassChained = true;
 }
 
 void Renderer::calculateViewModelMatrix(const Object& object, const Camera& camera, bool setViewRot)
@@ -145,31 +410,86 @@ void Renderer::calculateViewModelMatrix(const Object& object, const Camera& came
     psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::Translation>(posCamSpace);
 }
 
-bool Renderer::shouldCullObject(const Object& object, const Camera& camera) const
+bool Renderer::isSphereOutsideFrustum(const psyqo::Vec3& center, psyqo::FixedPoint<> radius) const
+{
+    const auto farZ = fogEnabled ? fogFar : VIEW_FAR;
+    if (center.z + radius < VIEW_NEAR || center.z - radius > farZ) {
+        return true;
+    }
+
+    // the frustum is symmetric, so only one side plane needs to be checked per axis
+    const auto x = center.x < 0.0 ? -center.x : center.x;
+    if (x * frustumSideX.x - center.z * frustumSideX.y > radius) {
+        return true;
+    }
+
+    const auto y = center.y < 0.0 ? -center.y : center.y;
+    if (y * frustumSideY.x - center.z * frustumSideY.y > radius) {
+        return true;
+    }
+
+    return false;
+}
+
+psyqo::Vec3 Renderer::toViewSpace(const Object& object,
+    const psyqo::Vec3& point,
+    const Camera& camera) const
+{
+    // model -> world
+    auto res = point;
+    if (object.hasRotation()) {
+        psyqo::SoftMath::matrixVecMul3(object.transform.rotation, res, &res);
+    }
+    res = res + object.transform.translation;
+
+    // world -> view (done on CPU so that R is not trashed)
+    res = res - camera.position;
+    psyqo::SoftMath::matrixVecMul3(camera.view.rotation, res, &res);
+    return res;
+}
+
+bool Renderer::shouldCullObject(const Object& object,
+    const MeshBounds& bounds,
+    const Camera& camera) const
+{
+    return isSphereOutsideFrustum(toViewSpace(object, bounds.center, camera), bounds.radius);
+}
+
+const MeshData& Renderer::selectLod(Mesh& mesh, psyqo::FixedPoint<> distance) const
 {
-    static constexpr auto cullDistance = psyqo::FixedPoint<>(6.f);
-    return math::distanceSq(object.getPosition(), camera.position) > cullDistance;
+    const auto& meshData = *mesh.meshData;
+
+    // switch only when the distance is a bit past the switching point in either direction,
+    // so that meshes standing right at it don't flicker between LODs
+    while (mesh.lod < meshData.numLods &&
+           distance > meshData.lods[mesh.lod].distance + LOD_HYSTERESIS) {
+        ++mesh.lod;
+    }
+    while (mesh.lod > 0 && distance < meshData.lods[mesh.lod - 1].distance - LOD_HYSTERESIS) {
+        --mesh.lod;
+    }
+
+    return mesh.lod == 0 ? meshData : *meshData.lods[mesh.lod - 1].meshData;
 }
 
 void Renderer::drawModelObject(ModelObject& object, const Camera& camera, bool setViewRot)
 {
-    if (shouldCullObject(object, camera)) {
+    const auto& bounds = object.model.bounds;
+    const auto center = toViewSpace(object, bounds.center, camera);
+    if (isSphereOutsideFrustum(center, bounds.radius)) {
+        ++numObjectsCulled;
         return;
     }
     calculateViewModelMatrix(object, camera, setViewRot);
 
-    drawModel(object.model);
+    drawModel(object.model, center.z);
 }
 
 void Renderer::drawAnimatedModelObject(AnimatedModelObject& object,
     const Camera& camera,
     bool setViewRot)
 {
-    if (shouldCullObject(object, camera)) {
-        return;
-    }
-
-    minAvgZ = 0xFFFFF;
+    minAvgZ = MIN_AVG_Z_UNSET;
     minSX = 500;
     minSY = 500;
     maxSX = -500;
@@ -183,8 +503,32 @@ void Renderer::drawAnimatedModelObject(AnimatedModelObject& object,
         return;
     }
 
+    const auto& jointViewTransforms = getJointViewTransforms(object, camera);
+
+    // model bounds can't be used for skinned models, so each submesh is culled separately
+    bool anyMeshDrawn = false;
+    ScreenExtent extent;
     for (auto& mesh : model.meshes) {
-        drawMeshArmature(object, camera, armature, mesh);
+        anyMeshDrawn |= drawMeshArmature(jointViewTransforms, mesh, extent);
+    }
+
+    if (!anyMeshDrawn) {
+        object.screenRadius = 0;
+        ++numObjectsCulled;
+        return;
+    }
+
+    { // for AnimationScheduler: half of the larger side of the drawn submeshes' screen box
+        const auto size = eastl::max(extent.maxX - extent.minX, extent.maxY - extent.minY);
+        const auto radius = extent.crossesNearPlane ?
+                                (std::int32_t)AnimatedModelObject::SCREEN_RADIUS_UNKNOWN :
+                                size / 2;
+        object.screenRadius = eastl::min(radius, (std::int32_t)0x7FFF);
+    }
+
+    // nothing was drawn with fog, so there's nothing to fade
+    if (!fogEnabled || minAvgZ == MIN_AVG_Z_UNSET) {
+        return;
     }
 
     { // fog fade rect
@@ -201,9 +545,9 @@ void Renderer::drawAnimatedModelObject(AnimatedModelObject& object,
         maxSY += 10;
 
         // we want it to be drawn after every primitive
-        // inserting at minAvgZ means that some prims could possibly be rendered after it,
-        // which is wrong
-        minAvgZ -= 1;
+        // inserting at the object's min bucket means that some prims could possibly be
+        // rendered after it, which is wrong
+        const auto rectZ = getLayerOTZ(minAvgZ, DepthLayer::Overlay);
 
         q.pointA.x = minSX;
         q.pointA.y = minSY;
@@ -224,70 +568,115 @@ void Renderer::drawAnimatedModelObject(AnimatedModelObject& object,
         { // 4. restore the mask bit for other prims
             auto& maskBit = primBuffer.allocateFragment<psyqo::Prim::MaskControl>(
                 psyqo::Prim::MaskControl::Set::FromSource, psyqo::Prim::MaskControl::Test::No);
-            ot.insert(maskBit, minAvgZ);
+            insertPrim(ot, maskBit, rectZ);
         }
 
         // 3. draw the quad itself
-        ot.insert(quadFrag, minAvgZ);
+        insertPrim(ot, quadFrag, rectZ);
 
         { // 2. Only draw to pixels which are with STP == 0
           // (animated objects must have textures with STP == 0 on all pixels)
             auto& maskBit = primBuffer.allocateFragment<psyqo::Prim::MaskControl>(
                 psyqo::Prim::MaskControl::Set::ForceSet, psyqo::Prim::MaskControl::Test::Yes);
-            ot.insert(maskBit, minAvgZ);
+            insertPrim(ot, maskBit, rectZ);
         }
 
         { // 1. previous prims might have changed the blending mode
             auto& tpage = primBuffer.allocateFragment<psyqo::Prim::TPage>();
             tpage.primitive.attr.setDithering(true).set(
                 psyqo::Prim::TPageAttr::SemiTrans::FullBackAndFullFront);
-            ot.insert(tpage, minAvgZ);
+            insertPrim(ot, tpage, rectZ);
         }
     }
 }
 
-void Renderer::drawMeshArmature(const AnimatedModelObject& object,
-    const Camera& camera,
-    const Armature& armature,
-    const Mesh& mesh)
+const eastl::vector<TransformMatrix>& Renderer::getJointViewTransforms(
+    AnimatedModelObject& object,
+    const Camera& camera)
 {
-    const auto& meshData = *mesh.meshData;
-    const auto& jointTransform = object.jointGlobalTransforms[meshData.jointId];
-
-    const auto t1 = combineTransforms(object.transform, jointTransform);
-
-    // This is basically combineTransforms(camera.view, t1),
-    // but we do a trick which allows us to prevent 4.12 range overflow
-    {
-        using namespace psyqo::GTE;
-        using namespace psyqo::GTE::Math;
+    auto& jointViewTransforms = object.jointViewTransforms;
+    const auto frame = gpu.getFrameCount();
+    if (object.jointViewTransformsFrame == frame) {
+        return jointViewTransforms;
+    }
+    object.jointViewTransformsFrame = frame;
 
-        TransformMatrix t2;
+    using namespace psyqo::GTE;
+    using namespace psyqo::GTE::Math;
 
-        // V * M * J
-        multiplyMatrix33<PseudoRegister::Rotation, PseudoRegister::V0>(
-            camera.view.rotation, t1.rotation, &t2.rotation);
+    // V * M
+    // Instead of using camera.view.translation (which is V * (-camPos)),
+    // we're going into the camera/view space and do calculations there.
+    // This prevents 4.12 range overflow.
+    TransformMatrix viewModel;
+    multiplyMatrix33<PseudoRegister::Rotation, PseudoRegister::V0>(
+        camera.view.rotation, object.transform.rotation, &viewModel.rotation);
+    viewModel.translation = object.transform.translation - camera.position;
+    matrixVecMul3<PseudoRegister::Rotation, // camera.view.rotation
+        PseudoRegister::V0>(viewModel.translation, &viewModel.translation);
+
+    // (V * M) * J: joint transforms are in model space
+    writeSafe<PseudoRegister::Rotation>(viewModel.rotation);
+    const auto& jointGlobalTransforms = object.jointGlobalTransforms;
+    jointViewTransforms.resize(jointGlobalTransforms.size());
+    for (std::size_t i = 0; i < jointGlobalTransforms.size(); ++i) {
+        const auto& jt = jointGlobalTransforms[i];
+        auto& out = jointViewTransforms[i];
+        multiplyMatrix33<PseudoRegister::Rotation, PseudoRegister::V0>(jt.rotation, &out.rotation);
+        matrixVecMul3<PseudoRegister::Rotation, PseudoRegister::V0>(
+            jt.translation, &out.translation);
+        out.translation += viewModel.translation;
+    }
 
-        // Instead of using camera.view.translation (which is V * (-camPos)),
-        // we're going into the camera/view space and do calculations there
-        t2.translation = t1.translation - camera.position;
-        matrixVecMul3<PseudoRegister::Rotation, // camera.view.rotation
-            PseudoRegister::V0>(t2.translation, &t2.translation);
+    return jointViewTransforms;
+}
 
-        writeUnsafe<PseudoRegister::Rotation>(t2.rotation);
-        writeSafe<PseudoRegister::Translation>(t2.translation);
+bool Renderer::drawMeshArmature(const eastl::vector<TransformMatrix>& jointViewTransforms,
+    Mesh& mesh,
+    ScreenExtent& extent)
+{
+    const auto& meshData = *mesh.meshData;
+    const auto& t = jointViewTransforms[meshData.jointId];
+
+    // bounds are in joint space, so V * M * J moves them into view space
+    auto center = meshData.bounds.center;
+    psyqo::SoftMath::matrixVecMul3(t.rotation, center, &center);
+    center = center + t.translation;
+    if (isSphereOutsideFrustum(center, meshData.bounds.radius)) {
+        return false;
+    }
+    const auto distance = center.z;
+
+    const auto radius = meshData.bounds.radius;
+    if (distance - radius > VIEW_NEAR) {
+        const auto scale = psyqo::FixedPoint<>((std::int32_t)h, 0) / distance;
+        const auto sx = (center.x * scale).integer();
+        const auto sy = (center.y * scale).integer();
+        const auto sr = (radius * scale).integer();
+        extent.minX = eastl::min(extent.minX, sx - sr);
+        extent.minY = eastl::min(extent.minY, sy - sr);
+        extent.maxX = eastl::max(extent.maxX, sx + sr);
+        extent.maxY = eastl::max(extent.maxY, sy + sr);
+    } else {
+        extent.crossesNearPlane = true;
     }
 
+    psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::Rotation>(t.rotation);
+    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::Translation>(t.translation);
+
+    const auto& lodMeshData = selectLod(mesh, distance);
     if (fogEnabled) {
-        drawMeshFog(meshData);
+        drawMeshFog(lodMeshData, DepthLayer::Character);
     } else {
-        drawMesh(meshData);
+        drawMesh(lodMeshData, DepthLayer::Character);
     }
+    return true;
 }
 
 void Renderer::drawMeshObject(MeshObject& object, const Camera& camera, bool setViewRot)
 {
-    if (shouldCullObject(object, camera)) {
+    if (shouldCullObject(object, object.mesh.meshData->bounds, camera)) {
+        ++numObjectsCulled;
         return;
     }
     calculateViewModelMatrix(object, camera, setViewRot);
@@ -298,1343 +687,1199 @@ void Renderer::drawMeshObject(MeshObject& object, const Camera& camera, bool set
     }
 }
 
-void Renderer::drawModel(const Model& model)
+void Renderer::drawModel(Model& model, psyqo::FixedPoint<> distance)
 {
-    for (const auto& mesh : model.meshes) {
+    for (auto& mesh : model.meshes) {
+        const auto& meshData = selectLod(mesh, distance);
         if (fogEnabled) {
-            drawMeshFog(*mesh.meshData);
+            drawMeshFog(meshData, DepthLayer::World);
         } else {
-            drawMesh(*mesh.meshData);
+            drawMesh(meshData, DepthLayer::World);
         }
     }
 }
 
-void Renderer::drawQuadSubdiv(const psyqo::Prim::GouraudTexturedQuad& prim, int avgZ, int addBias)
+namespace
 {
-    auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
+// Calculates row j of the face's grid (with 1 << level cells per side) and transforms
+// its vertices. Quad grids are interpolated bilinearly from the corners
+// (i goes from A to B, j goes from A to C), row j of a triangle's grid has n - j + 1 vertices.
+template<bool IsQuad>
+void calcSubdivRow(const Renderer& renderer,
+    const SubdivData& wrk,
+    SubdivVertex* row,
+    int level,
+    int j,
+    bool fog)
+{
+    static constexpr int numCorners = IsQuad ? 4 : 3;
+    const int n = 1 << level;
+    const int numVerts = IsQuad ? n + 1 : n - j + 1;
+    const int shift = IsQuad ? level * 2 : level;
+
+    psyqo::GTE::PackedVec3 pos[MAX_SUBDIV_GRID_SIZE];
+    for (int i = 0; i < numVerts; ++i) {
+        // weights of the corners (they sum up to 1 << shift)
+        int w[numCorners];
+        if constexpr (IsQuad) {
+            w[0] = (n - i) * (n - j);
+            w[1] = i * (n - j);
+            w[2] = (n - i) * j;
+            w[3] = i * j;
+        } else {
+            w[0] = n - i - j;
+            w[1] = i;
+            w[2] = j;
+        }
 
-    auto& wrk1 = *(SubdivData1*)(SCRATCH_PAD);
+        int x = 0, y = 0, z = 0;
+        int u = 0, v = 0;
+        int r = 0, g = 0, b = 0;
+        for (int k = 0; k < numCorners; ++k) {
+            x += w[k] * wrk.ov[k].pos.x.value;
+            y += w[k] * wrk.ov[k].pos.y.value;
+            z += w[k] * wrk.ov[k].pos.z.value;
+            u += w[k] * wrk.ouv[k].u;
+            v += w[k] * wrk.ouv[k].v;
+            r += w[k] * wrk.ocol[k].r;
+            g += w[k] * wrk.ocol[k].g;
+            b += w[k] * wrk.ocol[k].b;
+        }
 
-    /* verts set in drawMesh */
+        pos[i].x.value = (std::int16_t)(x >> shift);
+        pos[i].y.value = (std::int16_t)(y >> shift);
+        pos[i].z.value = (std::int16_t)(z >> shift);
+
+        auto& sv = row[i];
+        sv.uv.u = (std::uint8_t)(u >> shift);
+        sv.uv.v = (std::uint8_t)(v >> shift);
+        sv.col = psyqo::Color{
+            .r = (std::uint8_t)(r >> shift),
+            .g = (std::uint8_t)(g >> shift),
+            .b = (std::uint8_t)(b >> shift),
+        };
+    }
 
-    wrk1.ouv[0].u = prim.uvA.u;
-    wrk1.ouv[0].v = prim.uvA.v;
+    int i = 0;
+    for (; i + 3 <= numVerts; i += 3) {
+        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V0>(pos[i + 0]);
+        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V1>(pos[i + 1]);
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(pos[i + 2]);
+        psyqo::GTE::Kernels::rtpt();
 
-    wrk1.ouv[1].u = prim.uvB.u;
-    wrk1.ouv[1].v = prim.uvB.v;
+        row[i + 0].tv.sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY0>();
+        row[i + 1].tv.sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY1>();
+        row[i + 2].tv.sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+        if (fog) {
+            row[i + 0].tv.sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ1>();
+            row[i + 1].tv.sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ2>();
+            row[i + 2].tv.sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
+        }
+    }
 
-    wrk1.ouv[2].u = prim.uvC.u;
-    wrk1.ouv[2].v = prim.uvC.v;
+    for (; i < numVerts; ++i) {
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(pos[i]);
+        psyqo::GTE::Kernels::rtps();
 
-    wrk1.ouv[3].u = prim.uvD.u;
-    wrk1.ouv[3].v = prim.uvD.v;
+        row[i].tv.sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+        if (fog) {
+            row[i].tv.sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
+        }
+    }
 
-    wrk1.ocol[0] = prim.getColorA();
-    wrk1.ocol[1] = prim.colorB;
-    wrk1.ocol[2] = prim.colorC;
-    wrk1.ocol[3] = prim.colorD;
+    if (fog) {
+        // rtpt only calculates IR0 for the last vertex
+        for (i = 0; i < numVerts; ++i) {
+            auto& sv = row[i];
+            sv.tv.p = renderer.getDepthCue(sv.tv.sz);
+            sv.col = interpColor(sv.col, sv.tv.p);
+        }
+    }
+}
 
-    const auto tpage = prim.tpage;
-    const auto clut = prim.clutIndex;
+void setSubdivVertices(psyqo::Prim::GouraudTexturedTriangle& tri,
+    const SubdivVertex& a,
+    const SubdivVertex& b,
+    const SubdivVertex& c)
+{
+    tri.pointA.packed = a.tv.sxy;
+    tri.pointB.packed = b.tv.sxy;
+    tri.pointC.packed = c.tv.sxy;
+
+    tri.uvA.u = a.uv.u;
+    tri.uvA.v = a.uv.v;
+    tri.uvB.u = b.uv.u;
+    tri.uvB.v = b.uv.v;
+    tri.uvC.u = c.uv.u;
+    tri.uvC.v = c.uv.v;
+
+    tri.setColorA(a.col);
+    tri.setColorB(b.col);
+    tri.setColorC(c.col);
+}
 
-    if (avgZ < LEVEL_2_SUBDIV_DIST) {
-        auto& wrk2 = *(SubdivData2*)(SCRATCH_PAD);
-        for (int i = 0; i < 4; ++i) {
-            wrk2.oov[i] = wrk2.ov[i];
-            wrk2.oouv[i] = wrk2.ouv[i];
-            wrk2.oocol[i] = wrk2.ocol[i];
-        }
+void setSubdivVertices(psyqo::Prim::GouraudTexturedQuad& quad,
+    const SubdivVertex& a,
+    const SubdivVertex& b,
+    const SubdivVertex& c,
+    const SubdivVertex& d)
+{
+    quad.pointA.packed = a.tv.sxy;
+    quad.pointB.packed = b.tv.sxy;
+    quad.pointC.packed = c.tv.sxy;
+    quad.pointD.packed = d.tv.sxy;
+
+    quad.uvA.u = a.uv.u;
+    quad.uvA.v = a.uv.v;
+    quad.uvB.u = b.uv.u;
+    quad.uvB.v = b.uv.v;
+    quad.uvC.u = c.uv.u;
+    quad.uvC.v = c.uv.v;
+    quad.uvD.u = d.uv.u;
+    quad.uvD.v = d.uv.v;
+
+    quad.setColorA(a.col);
+    quad.setColorB(b.col);
+    quad.setColorC(c.col);
+    quad.setColorD(d.col);
+}
 
-        DRAW_QUADS_44(wrk2);
-        return;
+// Tiles are moved into camera space manually (T is 0 while drawing them)
+eastl::array<psyqo::GTE::PackedVec3, 4> getTileCorners(TileIndex tileIndex,
+    psyqo::FixedPoint<12, std::int16_t> height,
+    const Camera& camera)
+{
+    const auto x0 = psyqo::GTE::Short(toWorldCoords(tileIndex.x) - camera.position.x);
+    const auto x1 = psyqo::GTE::Short(toWorldCoords(tileIndex.x + 1) - camera.position.x);
+    const auto y = psyqo::GTE::Short(psyqo::FixedPoint<>(height) - camera.position.y);
+    const auto z0 = psyqo::GTE::Short(toWorldCoords(tileIndex.z) - camera.position.z);
+    const auto z1 = psyqo::GTE::Short(toWorldCoords(tileIndex.z + 1) - camera.position.z);
+
+    return {
+        psyqo::GTE::PackedVec3{x0, y, z0},
+        psyqo::GTE::PackedVec3{x1, y, z0},
+        psyqo::GTE::PackedVec3{x0, y, z1},
+        psyqo::GTE::PackedVec3{x1, y, z1},
+    };
+}
+
+void setTileSubdivCorners(SubdivData& wrk,
+    TileIndex tileIndex,
+    psyqo::FixedPoint<12, std::int16_t> height,
+    const Camera& camera)
+{
+    const auto corners = getTileCorners(tileIndex, height, camera);
+    for (int i = 0; i < 4; ++i) {
+        wrk.ov[i].pos = corners[i];
     }
+}
+
+// Tile mesh vertices are in tile space
+psyqo::GTE::PackedVec3 getTileMeshOrigin(TileIndex tileIndex,
+    const TileInfo& tileInfo,
+    const Camera& camera)
+{
+    const auto tileHeight = psyqo::FixedPoint<>(tileInfo.height);
+    return psyqo::GTE::PackedVec3{
+        psyqo::GTE::Short(psyqo::FixedPoint<>(tileIndex.x, 0) * Tile::SCALE - camera.position.x),
+        psyqo::GTE::Short(tileHeight - camera.position.y),
+        psyqo::GTE::Short(psyqo::FixedPoint<>(tileIndex.z, 0) * Tile::SCALE - camera.position.z),
+    };
+}
+
+void setTileQuadAttrs(psyqo::Prim::GouraudTexturedQuad& quadT, const TileInfo& tileInfo)
+{
+    // TODO: set this for a given chunk/map?
+    quadT.tpage.setPageX(5)
+        .setPageY(0)
+        .set(psyqo::Prim::TPageAttr::ColorMode::Tex8Bits)
+        .set(psyqo::Prim::TPageAttr::SemiTrans::FullBackAndFullFront);
+    quadT.clutIndex = psyqo::PrimPieces::ClutIndex(0, 240);
 
-    DRAW_QUADS_22(wrk1);
+    quadT.uvA.u = tileInfo.u0;
+    quadT.uvA.v = tileInfo.v0;
+    quadT.uvB.u = tileInfo.u1;
+    quadT.uvB.v = tileInfo.v0;
+    quadT.uvC.u = tileInfo.u0;
+    quadT.uvC.v = tileInfo.v1;
+    quadT.uvD.u = tileInfo.u1;
+    quadT.uvD.v = tileInfo.v1;
+}
 }
 
-void Renderer::drawMeshFog(const MeshData& meshData)
+void Renderer::drawQuadSubdiv(const psyqo::Prim::GouraudTexturedQuad& prim,
+    int level,
+    int avgZ,
+    bool fog)
 {
     auto& ot = getOrderingTable();
     auto& primBuffer = getPrimBuffer();
+    auto& wrk = getSubdivData();
+
+    const int n = 1 << level;
+    auto* top = wrk.rows[0];
+    auto* bottom = wrk.rows[1];
+    calcSubdivRow<true>(*this, wrk, top, level, 0, fog);
+    for (int j = 1; j <= n; ++j) {
+        calcSubdivRow<true>(*this, wrk, bottom, level, j, fog);
+        for (int i = 0; i < n; ++i) {
+            auto& quadFrag = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
+            auto& quad = quadFrag.primitive;
+            quad = prim; // copy tpage, clut and semi-trans flag
+            setSubdivVertices(quad, top[i], top[i + 1], bottom[i], bottom[i + 1]);
+            insertPrim(ot, quadFrag, avgZ);
+        }
+        eastl::swap(top, bottom);
+    }
+}
 
-    const auto& g3s = meshData.g3;
-    const auto& g4s = meshData.g4;
-    const auto& gt3s = meshData.gt3;
-    const auto& gt4s = meshData.gt4;
-
-    const auto g4Offset = g3s.size() * 3;
-    const auto gt3Offset = g4Offset + g4s.size() * 4;
-    const auto gt4Offset = gt3Offset + gt3s.size() * 3;
+void Renderer::drawTriangleSubdiv(const psyqo::Prim::GouraudTexturedTriangle& prim,
+    int level,
+    int avgZ,
+    bool fog)
+{
+    auto& ot = getOrderingTable();
+    auto& primBuffer = getPrimBuffer();
+    auto& wrk = getSubdivData();
+
+    const int n = 1 << level;
+    auto* top = wrk.rows[0];
+    auto* bottom = wrk.rows[1];
+    calcSubdivRow<false>(*this, wrk, top, level, 0, fog);
+    for (int j = 1; j <= n; ++j) {
+        calcSubdivRow<false>(*this, wrk, bottom, level, j, fog);
+
+        // top row has n - j + 2 vertices, bottom row has one less
+        const int numTop = n - j + 2;
+        for (int i = 0; i + 1 < numTop; ++i) {
+            auto& triFrag = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedTriangle>();
+            auto& tri = triFrag.primitive;
+            tri = prim; // copy tpage, clut and semi-trans flag
+            // same winding as the face: (i, j - 1), (i + 1, j - 1), (i, j)
+            setSubdivVertices(tri, top[i], top[i + 1], bottom[i]);
+            insertPrim(ot, triFrag, avgZ);
+
+            if (i + 2 < numTop) { // upside down: (i + 1, j - 1), (i + 1, j), (i, j)
+                auto& triFrag2 =
+                    primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedTriangle>();
+                auto& tri2 = triFrag2.primitive;
+                tri2 = prim;
+                setSubdivVertices(tri2, top[i + 1], bottom[i + 1], bottom[i]);
+                insertPrim(ot, triFrag2, avgZ);
+            }
+        }
+        eastl::swap(top, bottom);
+    }
+}
 
+template<Renderer::MeshDrawPolicy P>
+Renderer::TransformedVertex* Renderer::transformVertices(const MeshData& meshData,
+    psyqo::GTE::PackedVec3 origin)
+{
     const auto& verts = meshData.vertices;
+    const auto numVerts = verts.size();
 
-    uint32_t pa = 0;
-    const auto gt3ss = gt3s.size();
-    for (std::size_t i = 0; i < gt3ss; ++i) {
-        auto& triFrag = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedTriangle>();
-        auto& triT = triFrag.primitive;
+    // tile corner rows are stored at the start of the vertex cache while drawing tiles
+    static constexpr std::size_t scratchPadOffset =
+        P.vertexSource == VertexSource::Tile ? TILE_CORNER_ROW_SIZE * 2 : 0;
 
-        const auto& v0 = verts[gt3Offset + i * 3 + 0];
-        const auto& v1 = verts[gt3Offset + i * 3 + 1];
-        const auto& v2 = verts[gt3Offset + i * 3 + 2];
+    TransformedVertex* vs = nullptr;
+    if (numVerts + scratchPadOffset <= scratchPadVertexCacheSize) {
+        vs = (TransformedVertex*)(SCRATCH_PAD + sizeof(SubdivData)) + scratchPadOffset;
+    } else {
+        if (vertexCache.size() < numVerts) {
+            vertexCache.resize(numVerts);
+        }
+        vs = vertexCache.data();
+    }
 
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::Kernels::rtps();
+    const auto getPos = [&](std::size_t i) {
+        if constexpr (P.vertexSource == VertexSource::Tile) {
+            auto pos = verts[i].pos;
+            pos.x += origin.x;
+            pos.y += origin.y;
+            pos.z += origin.z;
+            return pos;
+        } else {
+            return verts[i].pos;
+        }
+    };
 
-        // do while rtps
-        const auto& prim = gt3s[i];
-        triT.tpage = prim.tpage;
+    std::size_t i = 0;
+    for (; i + 3 <= numVerts; i += 3) {
+        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V0>(getPos(i + 0));
+        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V1>(getPos(i + 1));
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(getPos(i + 2));
+        psyqo::GTE::Kernels::rtpt();
 
-        pa = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-        triT.setColorA(interpColorImm(prim.getColorA()));
+        vs[i + 0].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY0>();
+        vs[i + 1].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY1>();
+        vs[i + 2].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+        vs[i + 0].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ1>();
+        vs[i + 1].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ2>();
+        vs[i + 2].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
+
+        // rtpt only calculates IR0 for the last vertex
+        if constexpr (P.fog) {
+            vs[i + 0].p = getDepthCue(vs[i + 0].sz);
+            vs[i + 1].p = getDepthCue(vs[i + 1].sz);
+            vs[i + 2].p = getDepthCue(vs[i + 2].sz);
+        }
+    }
 
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v1.pos);
+    for (; i < numVerts; ++i) {
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(getPos(i));
         psyqo::GTE::Kernels::rtps();
 
-        // do while rtps
-        triT.clutIndex = prim.clutIndex;
-        triT.uvA = prim.uvA;
+        vs[i].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+        vs[i].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
+        if constexpr (P.fog) {
+            vs[i].p = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
+        }
+    }
+
+    return vs;
+}
 
-        const auto p1 = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-        triT.colorB = interpColorImm(prim.colorB);
+void Renderer::updateFadeRect(const TransformedVertex& v0,
+    const TransformedVertex& v1,
+    const TransformedVertex& v2,
+    const TransformedVertex& v3)
+{
+    psyqo::Vertex a, b, c, d;
+    a.packed = v0.sxy;
+    b.packed = v1.sxy;
+    c.packed = v2.sxy;
+    d.packed = v3.sxy;
+
+    minSX = eastl::min({minSX, a.x, b.x, c.x, d.x});
+    maxSX = eastl::max({maxSX, a.x, b.x, c.x, d.x});
+    minSY = eastl::min({minSY, a.y, b.y, c.y, d.y});
+    maxSY = eastl::max({maxSY, a.y, b.y, c.y, d.y});
+}
 
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v2.pos);
-        psyqo::GTE::Kernels::rtps();
+template<Renderer::MeshDrawPolicy P>
+void Renderer::drawMeshImpl(const MeshData& meshData,
+    DepthLayer layer,
+    MeshPackets* packets,
+    psyqo::GTE::PackedVec3 origin)
+{
+    if constexpr (P.staticPackets) {
+        if (packets->fogMode != P.fog) {
+            setPacketsFogMode(*packets, meshData, P.fog);
+        }
+    }
+
+    const auto* vs = transformVertices<P>(meshData, origin);
+    const auto layerBias = depthLayerBias[(std::size_t)layer];
+    drawMeshFaces<P, false>(meshData, vs, layerBias, packets, origin);
+    drawMeshFaces<P, true>(meshData, vs, layerBias, packets, origin);
+}
 
-        // do while rtps
-        triT.uvB = prim.uvB;
-        triT.uvC = prim.uvC;
+template<Renderer::MeshDrawPolicy P, bool IsQuad>
+void Renderer::drawMeshFaces(const MeshData& meshData,
+    const TransformedVertex* vs,
+    int layerBias,
+    MeshPackets* packets,
+    psyqo::GTE::PackedVec3 origin)
+{
+    using PrimType = eastl::conditional_t<IsQuad,
+        psyqo::Prim::GouraudTexturedQuad,
+        psyqo::Prim::GouraudTexturedTriangle>;
+    using FogPrimType =
+        eastl::conditional_t<IsQuad, psyqo::Prim::GouraudQuad, psyqo::Prim::GouraudTriangle>;
+    using MaskControlFragment = psyqo::Fragments::SimpleFragment<psyqo::Prim::MaskControl>;
+    static constexpr int numCorners = IsQuad ? 4 : 3;
+
+    // with fog overlay, faces are drawn semi-trans with neutral colors
+    static constexpr bool fogOverlay = P.fog && P.fogOverlay;
+    static constexpr bool neutralColors = fogOverlay || !P.vertexColors;
+    // textures with alpha are only used by static meshes (see setPacketsFogMode)
+    static constexpr bool hasAlphaTextures = IsQuad && P.staticPackets;
 
-        const auto p2 = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-        triT.colorC = interpColorImm(prim.colorC);
+    auto& ot = getOrderingTable();
+    auto& primBuffer = getPrimBuffer();
 
+    const auto& prims = [&]() -> const auto& {
+        if constexpr (IsQuad) {
+            return meshData.gt4;
+        } else {
+            return meshData.gt3;
+        }
+    }();
+
+    const auto gt3Offset = meshData.g3.size() * 3 + meshData.g4.size() * 4;
+    const auto* indices =
+        meshData.indices.data() + (IsQuad ? gt3Offset + meshData.gt3.size() * 3 : gt3Offset);
+
+    const auto numFaces = prims.size();
+    for (std::size_t i = 0; i < numFaces; ++i) {
+        const auto* faceIndices = &indices[i * numCorners];
+        const auto& v0 = vs[faceIndices[0]];
+        const auto& v1 = vs[faceIndices[1]];
+        const auto& v2 = vs[faceIndices[2]];
+        const auto& v3 = vs[faceIndices[numCorners - 1]]; // same as v2 for triangles
+
+        if constexpr (IsQuad) {
+            loadQuad(v0, v1, v2, v3);
+        } else {
+            loadTriangle(v0, v1, v2);
+        }
         psyqo::GTE::Kernels::nclip();
+
+        const auto& prim = prims[i];
         const auto addBias = getAddBias(prim);
+        // textures with alpha are drawn with mask bit tricks when fog is enabled (see below)
+        const bool alphaFog = hasAlphaTextures && P.fog && addBias == 3;
 
         const auto dot =
             (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
         if (dot < 0) {
-            continue;
+            // only quads can be double-sided
+            const bool doubleSided = IsQuad && P.faceFlags &&
+                                     (addBias == 2 || (hasAlphaTextures && addBias == 3));
+            if (!doubleSided) {
+                ++frameStats.numCulledNclip;
+                continue;
+            }
         }
 
-        psyqo::GTE::Kernels::avsz3();
+        if constexpr (IsQuad) {
+            psyqo::GTE::Kernels::avsz4();
+        } else {
+            psyqo::GTE::Kernels::avsz3();
+        }
 
         auto avgZ = (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
         if (avgZ == 0) { // cull
-            if (addBias != 2) {
-                continue;
-            }
+            ++frameStats.numCulledDepth;
+            continue;
         }
+        const auto otz = avgZ;
 
-        avgZ += bias + addBias; // add bias
+        avgZ += layerBias;
+        if constexpr (P.faceFlags) {
+            avgZ += addBias; // additional bias is stored in padding
+        }
 
         if (avgZ >= Renderer::OT_SIZE) {
+            ++frameStats.numCulledDepth;
             continue;
         }
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&triT.pointA.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&triT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&triT.pointC.packed);
-
-        ot.insert(triFrag, avgZ);
+        int level = 0;
+        if constexpr (P.subdivide) {
+            if (!alphaFog) {
+                if constexpr (IsQuad) {
+                    level = getSubdivLevel(v0, v1, v2, v3);
+                } else {
+                    level = getSubdivLevel(v0, v1, v2);
+                }
+                if (level > 0 && !canSubdivide<PrimType>(level)) {
+                    level = 0;
+                }
+            }
+        }
 
-        if ((uint32_t)avgZ < minAvgZ) {
-            minAvgZ = (uint32_t)avgZ;
-            minAvgP = pa;
+        psyqo::Fragments::SimpleFragment<PrimType>* fragT = nullptr;
+        if constexpr (P.staticPackets) {
+            if constexpr (IsQuad) {
+                fragT = &packets->gt4[i];
+            } else {
+                fragT = &packets->gt3[i];
+            }
         }
 
-        minSX = eastl::min({minSX, triT.pointA.x, triT.pointB.x, triT.pointC.x});
-        maxSX = eastl::max({maxSX, triT.pointA.x, triT.pointB.x, triT.pointC.x});
-        minSY = eastl::min({minSY, triT.pointA.y, triT.pointB.y, triT.pointC.y});
-        maxSY = eastl::max({maxSY, triT.pointA.y, triT.pointB.y, triT.pointC.y});
-    }
+        // allocated before the face itself: the face can't be drawn without it
+        psyqo::Fragments::SimpleFragment<FogPrimType>* fragFog = nullptr;
+        if constexpr (fogOverlay) {
+            if constexpr (P.staticPackets) {
+                if constexpr (IsQuad) {
+                    fragFog = &packets->gt4Fog[i];
+                } else {
+                    fragFog = &packets->gt3Fog[i];
+                }
+            } else {
+                fragFog = tryAllocatePrim<FogPrimType>();
+                if (!fragFog) {
+                    continue;
+                }
+                fragFog->primitive.setOpaque();
+            }
+        }
 
-    const auto gt4ss = gt4s.size();
-    for (std::size_t i = 0; i < gt4ss; ++i) {
-        const auto& v0 = verts[gt4Offset + i * 4 + 0];
-        const auto& v1 = verts[gt4Offset + i * 4 + 1];
-        const auto& v2 = verts[gt4Offset + i * 4 + 2];
-        const auto& v3 = verts[gt4Offset + i * 4 + 3];
-
-        auto& quadFrag = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-        auto& quadT = quadFrag.primitive;
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // do while rtps
-        const auto& prim = gt4s[i];
-        quadT.tpage = prim.tpage;
-
-        pa = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-        quadT.setColorA(interpColorImm(prim.getColorA()));
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v1.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // do while rtps
-        quadT.clutIndex = prim.clutIndex;
-        quadT.uvA = prim.uvA;
-        quadT.uvB = prim.uvB;
-
-        quadT.colorB = interpColorImm(prim.colorB);
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v2.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // do while rtps
-        quadT.uvC = prim.uvC;
-        quadT.uvD = prim.uvD;
-
-        quadT.colorC = interpColorImm(prim.colorC);
-
-        psyqo::GTE::Kernels::nclip();
-        const auto addBias = getAddBias(prim);
-
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            if (addBias != 2) {
-                continue;
-            }
-        }
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointA.packed);
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        quadT.colorD = interpColorImm(prim.colorD);
-
-        psyqo::GTE::Kernels::avsz4();
-
-        auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
-
-        avgZ += bias + addBias; // add bias
-
-        if (avgZ >= Renderer::OT_SIZE) {
+        if (alphaFog && !primBuffer.hasSpace(sizeof(MaskControlFragment) * 2, PRIMBUFF_RESERVE)) {
+            ++frameStats.numPrimsSkipped;
             continue;
         }
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quadT.pointC.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quadT.pointD.packed);
-
-        ot.insert(quadFrag, avgZ);
-
-        if ((uint32_t)avgZ < minAvgZ) {
-            minAvgZ = (uint32_t)avgZ;
-            minAvgP = pa;
-        }
-
-        minSX = eastl::min({minSX, quadT.pointA.x, quadT.pointB.x, quadT.pointC.x, quadT.pointD.x});
-        maxSX = eastl::max({maxSX, quadT.pointA.x, quadT.pointB.x, quadT.pointC.x, quadT.pointD.x});
-        minSY = eastl::min({minSY, quadT.pointA.y, quadT.pointB.y, quadT.pointC.y, quadT.pointD.y});
-        maxSY = eastl::max({maxSY, quadT.pointA.y, quadT.pointB.y, quadT.pointC.y, quadT.pointD.y});
-    }
-}
-
-void Renderer::drawMesh(const MeshData& meshData)
-{
-    auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
-
-    const auto& g3s = meshData.g3;
-    const auto& g4s = meshData.g4;
-    const auto& gt3s = meshData.gt3;
-    const auto& gt4s = meshData.gt4;
-
-    const auto g4Offset = g3s.size() * 3;
-    const auto gt3Offset = g4Offset + g4s.size() * 4;
-    const auto gt4Offset = gt3Offset + gt3s.size() * 3;
-
-    const auto& verts = meshData.vertices;
-
-    uint32_t pa = 0;
-    for (std::size_t i = 0; i < gt3s.size(); ++i) {
-        auto& triFrag = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedTriangle>();
-        auto& tri2d = triFrag.primitive;
-
-        const auto& prim = gt3s[i];
-        tri2d = prim; // copy
-
-        const auto& v0 = verts[gt3Offset + i * 3 + 0];
-        const auto& v1 = verts[gt3Offset + i * 3 + 1];
-        const auto& v2 = verts[gt3Offset + i * 3 + 2];
-
-        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V1>(v1.pos);
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(v2.pos);
-        psyqo::GTE::Kernels::rtpt();
-
-        psyqo::GTE::Kernels::nclip();
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            continue;
-        }
+        if (level > 0) {
+            auto& wrk = getSubdivData();
+            setSubdivCorners(wrk, meshData.vertices, faceIndices, numCorners);
+            if constexpr (P.vertexSource == VertexSource::Tile) {
+                for (int k = 0; k < numCorners; ++k) {
+                    wrk.ov[k].pos.x += origin.x;
+                    wrk.ov[k].pos.y += origin.y;
+                    wrk.ov[k].pos.z += origin.z;
+                }
+            }
+            setSubdivAttrs(wrk, prim);
+            if constexpr (neutralColors) {
+                for (int k = 0; k < numCorners; ++k) {
+                    wrk.ocol[k] = textureNeutral;
+                }
+            }
 
-        psyqo::GTE::Kernels::avsz3();
+            // all sub-faces are copies of this one
+            PrimType subdivPrim;
+            if constexpr (P.staticPackets) {
+                subdivPrim = fragT->primitive;
+            } else {
+                copyTexturedPrimAttrs(subdivPrim, prim);
+                if constexpr (fogOverlay) {
+                    subdivPrim.setSemiTrans();
+                }
+            }
 
-        auto avgZ = (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
+            if constexpr (IsQuad) {
+                drawQuadSubdiv(subdivPrim, level, avgZ, P.fog);
+            } else {
+                drawTriangleSubdiv(subdivPrim, level, avgZ, P.fog);
+            }
+        } else {
+            if constexpr (!P.staticPackets) {
+                fragT = tryAllocatePrim<PrimType>();
+                if (!fragT) {
+                    continue;
+                }
+                copyTexturedPrimAttrs(fragT->primitive, prim);
+                if constexpr (fogOverlay) {
+                    fragT->primitive.setSemiTrans();
+                }
+            }
 
-        avgZ += bias; // add bias
-        { // load additional bias stored in padding
-            const auto addBias = getAddBias(prim);
-            avgZ += addBias;
-        }
+            auto& primT = fragT->primitive;
+            setPrimPoints(primT, v0, v1, v2, v3);
+
+            // static packets already have the original colors when drawn without fog
+            if constexpr (P.fog && neutralColors) {
+                interpPrimColors(primT, textureNeutral, v0, v1, v2, v3);
+            } else if constexpr (P.fog) {
+                interpPrimColors(primT, prim, v0, v1, v2, v3);
+            } else if constexpr (!P.staticPackets && neutralColors) {
+                setPrimColors(primT, textureNeutral);
+            } else if constexpr (!P.staticPackets) {
+                copyPrimColors(primT, prim);
+            }
 
-        if (avgZ >= Renderer::OT_SIZE) {
-            continue;
+            if (!alphaFog) {
+                insertPrim(ot, *fragT, avgZ);
+            }
         }
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&tri2d.pointA.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&tri2d.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&tri2d.pointC.packed);
-
-        tri2d.setColorA(prim.getColorA());
-        tri2d.setColorB(prim.getColorB());
-        tri2d.setColorC(prim.getColorC());
-
-        ot.insert(triFrag, avgZ);
-    }
-
-    for (std::size_t i = 0; i < gt4s.size(); ++i) {
-        const auto& v0 = verts[gt4Offset + i * 4 + 0];
-        const auto& v1 = verts[gt4Offset + i * 4 + 1];
-        const auto& v2 = verts[gt4Offset + i * 4 + 2];
-        const auto& v3 = verts[gt4Offset + i * 4 + 3];
-
-        const auto& prim = gt4s[i];
-
-        auto& quadFrag = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-        auto& quad2d = quadFrag.primitive;
-
-        // quad2d = prim; // copy
-        quad2d.tpage = prim.tpage;
-        quad2d.clutIndex = prim.clutIndex;
-        quad2d.uvA = prim.uvA;
-        quad2d.uvB = prim.uvB;
-        quad2d.uvC = prim.uvC;
-        quad2d.uvD = prim.uvD;
-
-        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V1>(v1.pos);
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(v2.pos);
-        psyqo::GTE::Kernels::rtpt();
-
-        // load additional bias stored in padding
-        const auto addBias = getAddBias(prim);
-
-        psyqo::GTE::Kernels::nclip();
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            if (addBias != 2) {
-                continue;
+        if constexpr (fogOverlay) {
+            // the overlay is not subdivided: it has no texture to warp
+            auto& primFog = fragFog->primitive;
+            setPrimPoints(primFog, v0, v1, v2, v3);
+            primFog.setColorA(interpColorBack(fogColor, v0.p));
+            primFog.setColorB(interpColorBack(fogColor, v1.p));
+            primFog.setColorC(interpColorBack(fogColor, v2.p));
+            if constexpr (IsQuad) {
+                primFog.setColorD(interpColorBack(fogColor, v3.p));
             }
-        }
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quad2d.pointA.packed);
+            if (alphaFog) { // semi-trans flags are set in setPacketsFogMode
+                auto& maskBit2 = primBuffer.allocateFragment<psyqo::Prim::MaskControl>(
+                    psyqo::Prim::MaskControl::Set::FromSource,
+                    psyqo::Prim::MaskControl::Test::No);
+                insertPrim(ot, maskBit2, avgZ);
 
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-        psyqo::GTE::Kernels::rtps();
+                insertPrim(ot, *fragFog, avgZ);
 
-        psyqo::GTE::Kernels::avsz4();
+                auto& maskBit1 = primBuffer.allocateFragment<psyqo::Prim::MaskControl>(
+                    psyqo::Prim::MaskControl::Set::ForceSet,
+                    psyqo::Prim::MaskControl::Test::Yes);
+                insertPrim(ot, maskBit1, avgZ);
 
-        auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
+                insertPrim(ot, *fragT, avgZ);
+            } else {
+                insertPrim(ot, *fragFog, avgZ);
+            }
         }
 
-        avgZ += bias + addBias; // add bias
+        if constexpr (P.fog && !P.fogOverlay) {
+            if ((uint32_t)otz < minAvgZ) {
+                minAvgZ = (uint32_t)otz;
+                minAvgP = (v0.p + v1.p + v2.p + v3.p) / 4;
+            }
 
-        if (avgZ >= Renderer::OT_SIZE) {
-            continue;
+            updateFadeRect(v0, v1, v2, v3);
         }
-
-        quad2d.setColorA(prim.getColorA());
-        quad2d.setColorB(prim.getColorB());
-        quad2d.setColorC(prim.getColorC());
-        quad2d.setColorD(prim.getColorD());
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quad2d.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quad2d.pointC.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quad2d.pointD.packed);
-
-        ot.insert(quadFrag, avgZ);
     }
 }
 
-void Renderer::drawMeshStaticFog(const Mesh& mesh)
+void Renderer::drawMeshFog(const MeshData& meshData, DepthLayer layer)
 {
-    auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
-
-    const auto& meshData = *mesh.meshData;
-    const auto& g3s = meshData.g3;
-    const auto& g4s = meshData.g4;
-    const auto& gt3s = meshData.gt3;
-    const auto& gt4s = meshData.gt4;
-
-    const auto g4Offset = g3s.size() * 3;
-    const auto gt3Offset = g4Offset + g4s.size() * 4;
-    const auto gt4Offset = gt3Offset + gt3s.size() * 3;
-
-    const auto& verts = meshData.vertices;
-
-    const auto gt3ss = gt3s.size();
-    for (std::size_t i = 0; i < gt3ss; ++i) {
-        auto& triFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedTriangle>();
-        auto& triT = triFragT.primitive;
-        triT.setSemiTrans();
-
-        const auto& v0 = verts[gt3Offset + i * 3 + 0];
-        const auto& v1 = verts[gt3Offset + i * 3 + 1];
-        const auto& v2 = verts[gt3Offset + i * 3 + 2];
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // have some time while rtps does stuff
-        const auto& prim = gt3s[i];
-
-        triT.setColorA(interpColorImm(textureNeutral));
-
-        const auto pa = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v1.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // have some time while rtps does stuff
-        triT.tpage = prim.tpage;
-        triT.clutIndex = prim.clutIndex;
-
-        triT.colorB = interpColorImm(textureNeutral);
-        const auto pb = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v2.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // have some time while rtps does stuff
-        triT.uvA = prim.uvA;
-        triT.uvB = prim.uvB;
-        triT.uvC = prim.uvC;
-
-        triT.colorC = interpColorImm(textureNeutral);
-        const auto pc = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&triT.pointA.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&triT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&triT.pointC.packed);
-
-        psyqo::GTE::Kernels::nclip();
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            continue;
-        }
-
-        psyqo::GTE::Kernels::avsz3();
-
-        auto avgZ = (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
-
-        avgZ += bias; // add bias
-        { // load additional bias stored in padding
-            const auto addBias = getAddBias(prim);
-            avgZ += addBias;
-        }
-
-        if (avgZ >= Renderer::OT_SIZE) {
-            continue;
-        }
-
-        auto& triFragFog = primBuffer.allocateFragment<psyqo::Prim::GouraudTriangle>();
-        auto& triFog = triFragFog.primitive;
-
-        triFog.setColorA(interpColorBack(fogColor, pa));
-        triFog.colorB = interpColorBack(fogColor, pb);
-        triFog.colorC = interpColorBack(fogColor, pc);
-
-        triFog.pointA = triT.pointA;
-        triFog.pointB = triT.pointB;
-        triFog.pointC = triT.pointC;
-
-        ot.insert(triFragT, avgZ);
-        ot.insert(triFragFog, avgZ);
-    }
-
-    const auto gt4ss = gt4s.size();
-    for (std::size_t i = 0; i < gt4ss; ++i) {
-        const auto& v0 = verts[gt4Offset + i * 4 + 0];
-        const auto& v1 = verts[gt4Offset + i * 4 + 1];
-        const auto& v2 = verts[gt4Offset + i * 4 + 2];
-        const auto& v3 = verts[gt4Offset + i * 4 + 3];
-
-        auto& quadFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-        auto& quadT = quadFragT.primitive;
-        quadT.setSemiTrans();
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // do stuff while rtps works
-        const auto& prim = gt4s[i];
-
-        quadT.setColorA(interpColorImm(textureNeutral));
-        uint32_t pa = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v1.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // do stuff while rtps works
-        quadT.tpage = prim.tpage;
-        quadT.clutIndex = prim.clutIndex;
-
-        quadT.colorB = interpColorImm(textureNeutral);
-        uint32_t pb = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v2.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // do stuff while rtps works
-        quadT.uvA = prim.uvA;
-        quadT.uvB = prim.uvB;
-
-        quadT.colorC = interpColorImm(textureNeutral);
-        uint32_t pc = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-
-        psyqo::GTE::Kernels::nclip();
-        const auto addBias = getAddBias(prim);
-
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            if (addBias != 2 && addBias != 3) {
-                continue;
-            }
-        }
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointA.packed);
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        // do stuff while rtps works
-        quadT.uvC = prim.uvC;
-        quadT.uvD = prim.uvD;
-
-        quadT.colorD = interpColorImm(textureNeutral);
-        uint32_t pd = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-
-        psyqo::GTE::Kernels::avsz4();
-
-        auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
-
-        avgZ += bias + addBias; // add bias
-
-        if (avgZ >= Renderer::OT_SIZE) {
-            continue;
-        }
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quadT.pointC.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quadT.pointD.packed);
-
-        auto& quadFragFog = primBuffer.allocateFragment<psyqo::Prim::GouraudQuad>();
-        auto& quadFog = quadFragFog.primitive;
-
-        quadFog.setColorA(interpColorBack(fogColor, pa));
-        quadFog.colorB = interpColorBack(fogColor, pb);
-        quadFog.colorC = interpColorBack(fogColor, pc);
-        quadFog.colorD = interpColorBack(fogColor, pd);
-
-        quadFog.pointA = quadT.pointA;
-        quadFog.pointB = quadT.pointB;
-        quadFog.pointC = quadT.pointC;
-        quadFog.pointD = quadT.pointD;
-
-        if (addBias == 3) { // textures with alpha
-            quadFog.setSemiTrans();
-            quadT.setOpaque();
-
-            auto& maskBit2 = primBuffer.allocateFragment<psyqo::Prim::MaskControl>(
-                psyqo::Prim::MaskControl::Set::FromSource, psyqo::Prim::MaskControl::Test::No);
-            ot.insert(maskBit2, avgZ);
-
-            ot.insert(quadFragFog, avgZ);
-
-            auto& maskBit1 = primBuffer.allocateFragment<psyqo::Prim::MaskControl>(
-                psyqo::Prim::MaskControl::Set::ForceSet, psyqo::Prim::MaskControl::Test::Yes);
-            ot.insert(maskBit1, avgZ);
-
-            ot.insert(quadFragT, avgZ);
-
-        } else {
-            ot.insert(quadFragT, avgZ);
-            ot.insert(quadFragFog, avgZ);
-        }
-    }
+    drawMeshImpl<MeshDrawPolicy{.fog = true}>(meshData, layer);
 }
 
-void Renderer::drawMeshStatic(const Mesh& mesh)
+void Renderer::drawMesh(const MeshData& meshData, DepthLayer layer)
 {
-    auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
-
-    const auto& meshData = *mesh.meshData;
-    const auto& g3s = meshData.g3;
-    const auto& g4s = meshData.g4;
-    const auto& gt3s = meshData.gt3;
-    const auto& gt4s = meshData.gt4;
-
-    const auto g4Offset = g3s.size() * 3;
-    const auto gt3Offset = g4Offset + g4s.size() * 4;
-    const auto gt4Offset = gt3Offset + gt3s.size() * 3;
-
-    const auto& verts = meshData.vertices;
-
-    for (std::size_t i = 0; i < gt3s.size(); ++i) {
-        auto& triFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedTriangle>();
-        auto& triT = triFragT.primitive;
-
-        const auto& prim = gt3s[i];
-        triT.tpage = prim.tpage;
-        triT.clutIndex = prim.clutIndex;
-        triT.uvA = prim.uvA;
-        triT.uvB = prim.uvB;
-        triT.uvC = prim.uvC;
-
-        const auto& v0 = verts[gt3Offset + i * 3 + 0];
-        const auto& v1 = verts[gt3Offset + i * 3 + 1];
-        const auto& v2 = verts[gt3Offset + i * 3 + 2];
-
-        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V1>(v1.pos);
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(v2.pos);
-        psyqo::GTE::Kernels::rtpt();
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&triT.pointA.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&triT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&triT.pointC.packed);
-
-        psyqo::GTE::Kernels::nclip();
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            continue;
-        }
-
-        psyqo::GTE::Kernels::avsz3();
-
-        auto avgZ = (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
-
-        avgZ += bias; // add bias
-        { // load additional bias stored in padding
-            const auto addBias = getAddBias(prim);
-            avgZ += addBias;
-        }
-
-        if (avgZ >= Renderer::OT_SIZE) {
-            continue;
-        }
-
-        triT.setColorA(prim.getColorA());
-        triT.setColorB(prim.getColorB());
-        triT.setColorC(prim.getColorC());
-
-        ot.insert(triFragT, avgZ);
-    }
-
-    for (std::size_t i = 0; i < gt4s.size(); ++i) {
-        const auto& v0 = verts[gt4Offset + i * 4 + 0];
-        const auto& v1 = verts[gt4Offset + i * 4 + 1];
-        const auto& v2 = verts[gt4Offset + i * 4 + 2];
-        const auto& v3 = verts[gt4Offset + i * 4 + 3];
-
-        auto& quadFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-        auto& quadT = quadFragT.primitive;
-
-        const auto& prim = gt4s[i];
-        quadT.tpage = prim.tpage;
-        quadT.clutIndex = prim.clutIndex;
-        quadT.uvA = prim.uvA;
-        quadT.uvB = prim.uvB;
-        quadT.uvC = prim.uvC;
-        quadT.uvD = prim.uvD;
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V1>(v1.pos);
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(v2.pos);
-        psyqo::GTE::Kernels::rtpt();
-
-        // load additional bias stored in padding (while rtpt)
-        const auto addBias = getAddBias(prim);
-
-        psyqo::GTE::Kernels::nclip();
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            if (addBias != 2 && addBias != 3) {
-                continue;
-            }
-        }
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointA.packed);
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        psyqo::GTE::Kernels::avsz4();
-
-        auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
-
-        avgZ += bias + addBias; // add bias
-
-        if (avgZ >= Renderer::OT_SIZE) {
-            continue;
-        }
-
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quadT.pointC.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quadT.pointD.packed);
-
-        quadT.setColorA(prim.getColorA());
-        quadT.setColorB(prim.getColorB());
-        quadT.setColorC(prim.getColorC());
-        quadT.setColorD(prim.getColorD());
-
-        ot.insert(quadFragT, avgZ);
-    }
+    drawMeshImpl<MeshDrawPolicy{}>(meshData, layer);
 }
 
-void Renderer::calculateTileVisibility(const Camera& camera)
+void Renderer::drawMeshStaticFog(Mesh& mesh)
 {
-    const auto front = psyqo::Vec3{
-        .x = trig.sin(camera.rotation.y),
-        .y = 0.0,
-        .z = trig.cos(camera.rotation.y),
-    };
-
-    const auto fov = psyqo::Angle(0.27);
-    auto viewDistSide = psyqo::FixedPoint(3.5);
-
-    const auto yaw = camera.rotation.y;
-    psyqo::Vec3 origin = camera.position - front * 0.1;
-
-    if (camera.rotation.x > 0.15) {
-        // TODO: hande better - probably need to calculate based on pitch somehow
-        origin = camera.position - front * 0.5;
-        viewDistSide = psyqo::FixedPoint(4.0);
-    }
-
-    auto frustumLeft = origin + psyqo::Vec3{.x = viewDistSide * trig.sin(yaw - fov),
-                                    .y = 0,
-                                    .z = viewDistSide * trig.cos(yaw - fov)};
-    auto frustumRight = origin + psyqo::Vec3{.x = viewDistSide * trig.sin(yaw + fov),
-                                     .y = 0,
-                                     .z = viewDistSide * trig.cos(yaw + fov)};
-
-    const auto minX = eastl::min({origin.x, frustumLeft.x, frustumRight.x});
-    const auto minZ = eastl::min({origin.z, frustumLeft.z, frustumRight.z});
-    const auto maxX = eastl::max({origin.x, frustumLeft.x, frustumRight.x});
-    const auto maxZ = eastl::max({origin.z, frustumLeft.z, frustumRight.z});
-
-    minTileX = (minX * Tile::SIZE).floor();
-    minTileZ = (minZ * Tile::SIZE).floor();
-    maxTileX = (maxX * Tile::SIZE).ceil();
-    maxTileZ = (maxZ * Tile::SIZE).ceil();
-
-    const auto originTileX = (origin.x * Tile::SIZE).floor();
-    const auto originTileZ = (origin.z * Tile::SIZE).floor();
-
-    const auto pLeftTileX = (frustumLeft.x * Tile::SIZE).floor();
-    const auto pLeftTiLeZ = (frustumLeft.z * Tile::SIZE).floor();
-
-    const auto pRightTileX = (frustumRight.x * Tile::SIZE).floor();
-    const auto pRightTileZ = (frustumRight.z * Tile::SIZE).floor();
-
-    tileSeen.reset();
-
-    rasterizeTriangle(tileSeen,
-        maxTileZ - originTileZ,
-        maxTileX - originTileX,
-        maxTileZ - pLeftTiLeZ,
-        maxTileX - pLeftTileX,
-        maxTileZ - pRightTileZ,
-        maxTileX - pRightTileX);
+    drawMeshImpl<MeshDrawPolicy{.fog = true, .fogOverlay = true, .staticPackets = true}>(
+        *mesh.meshData, DepthLayer::World, &mesh.packets[gpu.getParity()]);
 }
 
-void Renderer::drawTiles(const ModelData& tileModels, const TileMap& tileMap, const Camera& camera)
+void Renderer::drawMeshStatic(Mesh& mesh)
 {
-    calculateTileVisibility(camera);
-
-    numTilesDrawn = 0;
-
-    // all translation is handled by us moving tiles into camera space manually
-    static constexpr psyqo::Vec3 v{};
-    psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::Translation>(v);
-
-    const auto fog = fogEnabled;
-    for (int16_t z = minTileZ; z <= maxTileZ; ++z) {
-        for (int16_t x = minTileX; x <= maxTileX; ++x) {
-            const int xrel = maxTileX - x;
-            const int zrel = maxTileZ - z;
-            if (xrel >= 0 && xrel < MAX_TILES_DIM && zrel >= 0 && zrel < MAX_TILES_DIM &&
-                tileSeen[xrel * MAX_TILES_DIM + zrel] == 1) {
-                const auto tileIndex = TileIndex{x, z};
-                const auto tile = tileMap.getTile(tileIndex);
-                if (tile.tileId == Tile::NULL_TILE_ID) {
-                    continue;
-                }
-                if (fog) {
-                    drawTileFog(tileIndex, tile, tileMap.tileset, tileModels, camera);
-                } else {
-                    drawTile(tileIndex, tile, tileMap.tileset, tileModels, camera);
-                }
-                ++numTilesDrawn;
-            }
-        }
-    }
+    drawMeshImpl<MeshDrawPolicy{.staticPackets = true}>(
+        *mesh.meshData, DepthLayer::World, &mesh.packets[gpu.getParity()]);
 }
 
-void Renderer::drawTileFog(TileIndex tileIndex,
-    const Tile& tile,
-    const Tileset& tileset,
-    const ModelData& tileMeshes,
-    const Camera& camera)
+void Renderer::calculateTileVisibility(const Camera& camera, const TileMap& tileMap)
 {
-    auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
-
-    const auto tileId = tile.tileId;
-    const auto& tileInfo = tileset.getTileInfo(tileId);
-    const auto modelId = tileInfo.modelId;
-
-    if (modelId != TileInfo::NULL_MODEL_ID) { // "model" tiles
-        drawTileMeshFog(tileIndex, tile, tileset, tileMeshes.meshes[modelId], camera);
-        return;
+    visibleTileChunks.clear();
+
+    // The view frustum (cut by the near and far planes) is intersected with the ground plane.
+    // The result is a convex polygon: its vertices are the points where frustum's edges
+    // cross the ground.
+    const psyqo::Vec3 right = camera.view.rotation.vs[0];
+    const psyqo::Vec3 down = camera.view.rotation.vs[1];
+    const psyqo::Vec3 front = camera.view.rotation.vs[2];
+
+    // tan(fov / 2) for both axes
+    const auto tanX =
+        psyqo::FixedPoint<>(((SCREEN_WIDTH / 2) << 12) / (int32_t)h, psyqo::FixedPoint<>::RAW);
+    const auto tanY =
+        psyqo::FixedPoint<>(((SCREEN_HEIGHT / 2) << 12) / (int32_t)h, psyqo::FixedPoint<>::RAW);
+
+    // everything past fog's "far" has fog color and can't be seen
+    const auto nearZ = VIEW_NEAR;
+    const auto farZ = fogEnabled ? fogFar : VIEW_FAR;
+
+    // 0-3 - near plane corners, 4-7 - far plane corners
+    eastl::array<psyqo::Vec3, 8> corners;
+    static constexpr int signs[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+    for (int i = 0; i < 4; ++i) {
+        // view depth (dot(front, dir)) is 1 for all rays
+        const auto dir = front + right * (tanX * signs[i][0]) + down * (tanY * signs[i][1]);
+        corners[i] = camera.position + dir * nearZ;
+        corners[i + 4] = camera.position + dir * farZ;
     }
 
-    const int x = tileIndex.x;
-    const int z = tileIndex.z;
-
-    const auto tileHeight = psyqo::FixedPoint<>(tileInfo.height);
-
-    const auto v0 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z) - camera.position.z),
-            },
+    static constexpr int frustumEdges[12][2] = {
+        {0, 1}, {1, 2}, {2, 3}, {3, 0}, // near
+        {4, 5}, {5, 6}, {6, 7}, {7, 4}, // far
+        {0, 4}, {1, 5}, {2, 6}, {3, 7}, // sides
     };
 
-    const auto v1 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x + 1) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z) - camera.position.z),
-            },
-    };
+    const auto originTile = TileMap::getTileIndex(camera.position);
 
-    const auto v2 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z + 1) - camera.position.z),
-            },
-    };
-
-    const auto v3 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x + 1) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z + 1) - camera.position.z),
-            },
-    };
-
-    auto& quadFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-    auto& quadT = quadFragT.primitive;
-
-    // TODO: set this for a given chunk/map?
-    quadT.tpage.setPageX(5)
-        .setPageY(0)
-        .set(psyqo::Prim::TPageAttr::ColorMode::Tex8Bits)
-        .set(psyqo::Prim::TPageAttr::SemiTrans::FullBackAndFullFront);
-#define getClut(x, y) (((y) << 6) | (((x) >> 4) & 0x3f))
-    quadT.clutIndex = psyqo::PrimPieces::ClutIndex(0, 240);
-
-    auto& quadFragFog = primBuffer.allocateFragment<psyqo::Prim::GouraudQuad>();
-    auto& quadFog = quadFragFog.primitive;
-
-    quadFog.setOpaque();
-    quadT.setSemiTrans();
-
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-    psyqo::GTE::Kernels::rtps();
+    eastl::array<TilePoint, 12> points;
+    int numPoints = 0;
+    for (const auto& [ai, bi] : frustumEdges) {
+        const auto& p = corners[ai];
+        const auto& q = corners[bi];
+        // ground is at y == 0
+        if ((p.y.value < 0) == (q.y.value < 0)) {
+            continue;
+        }
 
-    // do while rtps does work
-    quadT.uvA.u = tileInfo.u0;
-    quadT.uvA.v = tileInfo.v0;
+        const auto t = p.y / (p.y - q.y);
+        const auto x = p.x + (q.x - p.x) * t;
+        const auto z = p.z + (q.z - p.z) * t;
 
-    quadT.setColorA(interpColorImm(textureNeutral));
-    uint32_t pa = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-    quadFog.setColorA(interpColorBack(fogColor, pa));
+        // world units -> tiles -> sub-tiles
+        static constexpr int shift = 12 - 3 - SUBTILE_SHIFT; // only for Tile::SIZE == 8
+        points[numPoints++] = TilePoint{
+            .x = (x.value >> shift) - (originTile.x << SUBTILE_SHIFT),
+            .z = (z.value >> shift) - (originTile.z << SUBTILE_SHIFT),
+        };
+    }
 
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v1.pos);
-    psyqo::GTE::Kernels::rtps();
+    eastl::array<TilePoint, 12> hull;
+    const int numHullPoints = convexHull(points.data(), numPoints, hull.data());
+    if (numHullPoints < 3) { // the ground can't be seen
+        return;
+    }
 
-    // do while rtps does work
-    quadT.uvB.u = tileInfo.u1;
-    quadT.uvB.v = tileInfo.v0;
+    eastl::array<TileEdge, 12> edges;
+    int minX = hull[0].x, maxX = hull[0].x;
+    int minZ = hull[0].z, maxZ = hull[0].z;
+    for (int i = 0; i < numHullPoints; ++i) {
+        edges[i] = makeTileEdge(hull[i], hull[(i + 1) % numHullPoints]);
+        minX = eastl::min(minX, hull[i].x);
+        maxX = eastl::max(maxX, hull[i].x);
+        minZ = eastl::min(minZ, hull[i].z);
+        maxZ = eastl::max(maxZ, hull[i].z);
+    }
 
-    quadT.setColorB(interpColorImm(textureNeutral));
-    uint32_t pb = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-    quadFog.setColorB(interpColorBack(fogColor, pb));
+    // chunks which can be overlapped by the polygon
+    const int firstChunkX = eastl::max(0,
+        ((minX >> SUBTILE_SHIFT) + originTile.x - tileMap.minX) >> TileMap::CHUNK_SHIFT);
+    const int firstChunkZ = eastl::max(0,
+        ((minZ >> SUBTILE_SHIFT) + originTile.z - tileMap.minZ) >> TileMap::CHUNK_SHIFT);
+    const int lastChunkX = eastl::min((int)tileMap.widthInChunks - 1,
+        ((maxX >> SUBTILE_SHIFT) + originTile.x - tileMap.minX) >> TileMap::CHUNK_SHIFT);
+    const int lastChunkZ = eastl::min((int)tileMap.heightInChunks - 1,
+        ((maxZ >> SUBTILE_SHIFT) + originTile.z - tileMap.minZ) >> TileMap::CHUNK_SHIFT);
+
+    for (int cz = firstChunkZ; cz <= lastChunkZ; ++cz) {
+        for (int cx = firstChunkX; cx <= lastChunkX; ++cx) {
+            const auto chunkId = tileMap.chunkIds[cz * tileMap.widthInChunks + cx];
+            if (chunkId == TileMap::NULL_CHUNK_ID) {
+                continue;
+            }
 
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v2.pos);
-    psyqo::GTE::Kernels::rtps();
+            const int chunkMinX = tileMap.minX + (cx << TileMap::CHUNK_SHIFT);
+            const int chunkMinZ = tileMap.minZ + (cz << TileMap::CHUNK_SHIFT);
 
-    // do while rtps does work
-    quadT.uvC.u = tileInfo.u0;
-    quadT.uvC.v = tileInfo.v1;
+            // relative to the camera's tile
+            const int localMinX = chunkMinX - originTile.x;
+            const int localMinZ = chunkMinZ - originTile.z;
 
-    quadT.setColorC(interpColorImm(textureNeutral));
-    uint32_t pc = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-    quadFog.setColorC(interpColorBack(fogColor, pc));
+            // cull whole chunks first
+            bool outside = false;
+            for (int i = 0; i < numHullPoints && !outside; ++i) {
+                outside = edges[i].maxOverSquare(localMinX << SUBTILE_SHIFT,
+                              localMinZ << SUBTILE_SHIFT,
+                              TileMap::CHUNK_SIZE << SUBTILE_SHIFT) < 0;
+            }
+            if (outside) {
+                continue;
+            }
 
-    psyqo::GTE::Kernels::nclip();
-    const auto dot = (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-    if (dot < 0) {
-        return;
+            VisibleTileChunk chunk{
+                .minX = chunkMinX,
+                .minZ = chunkMinZ,
+                .tiles = &tileMap.chunks[chunkId],
+            };
+            if (rasterizeTilePolygon(
+                    chunk.rows, localMinX, localMinZ, edges.data(), numHullPoints)) {
+                visibleTileChunks.push_back(chunk);
+            }
+        }
     }
+}
 
-    psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointA.packed);
+void Renderer::drawTiles(const ModelData& tileModels, const TileMap& tileMap, const Camera& camera)
+{
+    calculateTileVisibility(camera, tileMap);
 
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-    psyqo::GTE::Kernels::rtps();
+    numTilesDrawn = 0;
 
-    // do while rtps does work
-    quadT.uvD.u = tileInfo.u1;
-    quadT.uvD.v = tileInfo.v1;
+    // all translation is handled by us moving tiles into camera space manually
+    static constexpr psyqo::Vec3 v{};
+    psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::Translation>(v);
 
-    quadT.setColorD(interpColorImm(textureNeutral));
-    uint32_t pd = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
-    quadFog.setColorD(interpColorBack(fogColor, pd));
+    // Flat tiles share their corners with neighbours, so instead of doing 4 rtps per tile,
+    // each row of corners is transformed once and stored in the scratchpad.
+    // Two rows are kept: the bottom row of the current tile row becomes
+    // the top row of the next one.
+    // The vertex cache is not used while drawing tiles (tile meshes are drawn without it),
+    // so the corner rows can be stored in the same place.
+    static_assert(TILE_CORNER_ROW_SIZE * 2 <= scratchPadVertexCacheSize);
+    auto* corners = (TransformedVertex*)(SCRATCH_PAD + sizeof(SubdivData));
+    tileCornerRows[0] = TileCornerRow{.corners = corners};
+    tileCornerRows[1] = TileCornerRow{.corners = corners + TILE_CORNER_ROW_SIZE};
 
-    psyqo::GTE::Kernels::avsz4();
+    const auto fog = fogEnabled;
+    for (const auto& chunk : visibleTileChunks) {
+        for (int zi = 0; zi < TileMap::CHUNK_SIZE; ++zi) {
+            const auto rowSeen = chunk.rows[zi];
+            if (rowSeen == 0) {
+                continue;
+            }
 
-    auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-    if (avgZ == 0) { // cull
-        return;
-    }
+            const auto z = (int16_t)(chunk.minZ + zi);
+            const auto* rowTiles = &chunk.tiles->tiles[zi * TileMap::CHUNK_SIZE];
 
-    avgZ += floorBias;
-    if (tileHeight < 0.0) { // TEMP HACK: this makes pavements less glitchy
-        avgZ += 200;
-    }
+            // find visible tiles of the row and the height of the flat tiles in it
+            int rowMin = TileMap::CHUNK_SIZE;
+            int rowMax = -1;
+            bool hasFlatTiles = false;
+            psyqo::FixedPoint<12, std::int16_t> rowHeight{};
+            for (int i = 0; i < TileMap::CHUNK_SIZE; ++i) {
+                if ((rowSeen & (1 << i)) == 0 || rowTiles[i].tileId == Tile::NULL_TILE_ID) {
+                    continue;
+                }
 
-    psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointB.packed);
-    psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quadT.pointC.packed);
-    psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quadT.pointD.packed);
+                rowMin = eastl::min(rowMin, i);
+                rowMax = eastl::max(rowMax, i);
 
-    quadFog.pointA = quadT.pointA;
-    quadFog.pointB = quadT.pointB;
-    quadFog.pointC = quadT.pointC;
-    quadFog.pointD = quadT.pointD;
+                const auto& tileInfo = tileMap.tileset.getTileInfo(rowTiles[i].tileId);
+                if (!hasFlatTiles && tileInfo.modelId == TileInfo::NULL_MODEL_ID) {
+                    hasFlatTiles = true;
+                    rowHeight = tileInfo.height;
+                }
+            }
 
-    ot.insert(quadFragT, avgZ);
-    ot.insert(quadFragFog, avgZ);
-}
+            if (rowMax == -1) {
+                continue;
+            }
 
-void Renderer::drawTile(TileIndex tileIndex,
-    const Tile& tile,
-    const Tileset& tileset,
-    const ModelData& tileMeshes,
-    const Camera& camera)
-{
-    auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
+            const TransformedVertex* top = nullptr;
+            const TransformedVertex* bottom = nullptr;
+            if (hasFlatTiles) {
+                // corners of tile (x, z) are (x, z), (x + 1, z), (x, z + 1), (x + 1, z + 1)
+                top = getTileCornerRow(z, rowHeight, chunk.minX, rowMin, rowMax + 1, camera, fog);
+                bottom =
+                    getTileCornerRow(z + 1, rowHeight, chunk.minX, rowMin, rowMax + 1, camera, fog);
+            }
 
-    const auto tileId = tile.tileId;
-    const auto& tileInfo = tileset.getTileInfo(tileId);
-    const auto modelId = tileInfo.modelId;
+            for (int i = rowMin; i <= rowMax; ++i) {
+                const auto& tile = rowTiles[i];
+                if ((rowSeen & (1 << i)) == 0 || tile.tileId == Tile::NULL_TILE_ID) {
+                    continue;
+                }
 
-    if (modelId != TileInfo::NULL_MODEL_ID) { // "model" tiles
-        drawTileMesh(tileIndex, tile, tileset, tileMeshes.meshes[modelId], camera);
-        return;
+                const auto& tileInfo = tileMap.tileset.getTileInfo(tile.tileId);
+                const auto tileIndex = TileIndex{(int16_t)(chunk.minX + i), z};
+                if (tileInfo.modelId == TileInfo::NULL_MODEL_ID &&
+                    tileInfo.height.value == rowHeight.value) {
+                    const auto& v0 = top[i];
+                    const auto& v1 = top[i + 1];
+                    const auto& v2 = bottom[i];
+                    const auto& v3 = bottom[i + 1];
+                    if (fog) {
+                        drawTileQuadFog(tileIndex, tileInfo, camera, v0, v1, v2, v3);
+                    } else {
+                        drawTileQuad(tileIndex, tileInfo, camera, v0, v1, v2, v3);
+                    }
+                } else { // model tiles or tiles which are higher/lower than the rest of the row
+                    if (fog) {
+                        drawTileFog(tileIndex, tile, tileMap.tileset, tileModels, camera);
+                    } else {
+                        drawTile(tileIndex, tile, tileMap.tileset, tileModels, camera);
+                    }
+                }
+                ++numTilesDrawn;
+            }
+        }
     }
+}
 
-    const int x = tileIndex.x;
-    const int z = tileIndex.z;
-
-    const auto tileHeight = psyqo::FixedPoint<>(tileInfo.height);
+const Renderer::TransformedVertex* Renderer::getTileCornerRow(int z,
+    psyqo::FixedPoint<12, std::int16_t> height,
+    int baseX,
+    int minIndex,
+    int maxIndex,
+    const Camera& camera,
+    bool fog)
+{
+    auto& row = tileCornerRows[z & 1];
+    if (row.z == z && row.baseX == baseX && row.height.value == height.value &&
+        row.minIndex <= minIndex && row.maxIndex >= maxIndex) {
+        return row.corners;
+    }
 
-    const auto v0 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z) - camera.position.z),
-            },
+    row.z = z;
+    row.baseX = baseX;
+    row.height = height;
+    row.minIndex = minIndex;
+    row.maxIndex = maxIndex;
+
+    const auto cy = psyqo::GTE::Short(psyqo::FixedPoint<>(height) - camera.position.y);
+    const auto cz = psyqo::GTE::Short(toWorldCoords(z) - camera.position.z);
+    const auto cornerPos = [&](int i) {
+        return psyqo::GTE::PackedVec3{
+            psyqo::GTE::Short(toWorldCoords(baseX + i) - camera.position.x),
+            cy,
+            cz,
+        };
     };
 
-    const auto v1 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x + 1) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z) - camera.position.z),
-            },
-    };
+    auto* vs = row.corners;
+    int i = minIndex;
+    for (; i + 2 <= maxIndex; i += 3) {
+        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V0>(cornerPos(i + 0));
+        psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V1>(cornerPos(i + 1));
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(cornerPos(i + 2));
+        psyqo::GTE::Kernels::rtpt();
 
-    const auto v2 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z + 1) - camera.position.z),
-            },
-    };
+        vs[i + 0].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY0>();
+        vs[i + 1].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY1>();
+        vs[i + 2].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+        vs[i + 0].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ1>();
+        vs[i + 1].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ2>();
+        vs[i + 2].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
+    }
 
-    const auto v3 = Vec3Pad{
-        .pos =
-            psyqo::GTE::PackedVec3{
-                psyqo::GTE::Short(toWorldCoords(x + 1) - camera.position.x),
-                psyqo::GTE::Short(tileHeight - camera.position.y),
-                psyqo::GTE::Short(toWorldCoords(z + 1) - camera.position.z),
-            },
-    };
+    for (; i <= maxIndex; ++i) {
+        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(cornerPos(i));
+        psyqo::GTE::Kernels::rtps();
 
-    auto& quadFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-    auto& quadT = quadFragT.primitive;
-    // TODO: set this for a given chunk/map?
-    quadT.tpage.setPageX(5)
-        .setPageY(0)
-        .set(psyqo::Prim::TPageAttr::ColorMode::Tex8Bits)
-        .set(psyqo::Prim::TPageAttr::SemiTrans::FullBackAndFullFront);
-#define getClut(x, y) (((y) << 6) | (((x) >> 4) & 0x3f))
-    quadT.clutIndex = psyqo::PrimPieces::ClutIndex(0, 240);
+        vs[i].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+        vs[i].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
+    }
 
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V1>(v1.pos);
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(v2.pos);
-    psyqo::GTE::Kernels::rtpt();
+    if (fog) {
+        // rtpt only calculates IR0 for the last vertex
+        for (i = minIndex; i <= maxIndex; ++i) {
+            vs[i].p = getDepthCue(vs[i].sz);
+        }
+    }
 
-    // do while rtpt
-    quadT.uvA.u = tileInfo.u0;
-    quadT.uvA.v = tileInfo.v0;
-    quadT.uvB.u = tileInfo.u1;
-    quadT.uvB.v = tileInfo.v0;
-    quadT.uvC.u = tileInfo.u0;
-    quadT.uvC.v = tileInfo.v1;
-    quadT.uvD.u = tileInfo.u1;
-    quadT.uvD.v = tileInfo.v1;
+    return vs;
+}
 
+void Renderer::drawTileQuadFog(TileIndex tileIndex,
+    const TileInfo& tileInfo,
+    const Camera& camera,
+    const TransformedVertex& v0,
+    const TransformedVertex& v1,
+    const TransformedVertex& v2,
+    const TransformedVertex& v3)
+{
+    loadQuad(v0, v1, v2, v3);
     psyqo::GTE::Kernels::nclip();
     const auto dot = (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
     if (dot < 0) {
+        ++frameStats.numCulledNclip;
         return;
     }
 
-    psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointA.packed);
-
-    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-    psyqo::GTE::Kernels::rtps();
-
-    // do while rtps is doing this
-    quadT.setColorA(textureNeutral);
-    quadT.setColorB(textureNeutral);
-    quadT.setColorC(textureNeutral);
-    quadT.setColorD(textureNeutral);
-
     psyqo::GTE::Kernels::avsz4();
-
     auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
     if (avgZ == 0) { // cull
+        ++frameStats.numCulledDepth;
         return;
     }
 
-    avgZ += floorBias;
-
-    psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointB.packed);
-    psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quadT.pointC.packed);
-    psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quadT.pointD.packed);
-
-    ot.insert(quadFragT, avgZ);
-}
-
-void Renderer::drawTileMeshFog(TileIndex tileIndex,
-    const Tile& tile,
-    const Tileset& tileset,
-    const MeshData& meshData,
-    const Camera& camera)
-{
-    const int x = tileIndex.x;
-    const int z = tileIndex.z;
+    avgZ = getLayerOTZ(avgZ, getTileLayer(tileInfo));
+    if (avgZ >= OT_SIZE) {
+        ++frameStats.numCulledDepth;
+        return;
+    }
 
     auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
-
-    // mostly like drawMeshStatic, but moves each vertex into camera space without
-    // using rotation/translation registers
-    // - FIXME: remove copy-paste
-    const auto& g3s = meshData.g3;
-    const auto& g4s = meshData.g4;
-    const auto& gt3s = meshData.gt3;
-    const auto& gt4s = meshData.gt4;
-    const auto& verts = meshData.vertices;
-
-    const auto g4Offset = g3s.size() * 3;
-    const auto gt3Offset = g4Offset + g4s.size() * 4;
-    const auto gt4Offset = gt3Offset + gt3s.size() * 3;
-
-    const auto& tileInfo = tileset.getTileInfo(tile.tileId);
-    const auto tileHeight = psyqo::FixedPoint<>(tileInfo.height);
-
-    const auto originX =
-        psyqo::GTE::Short(psyqo::FixedPoint<>(x, 0) * Tile::SCALE - camera.position.x);
-    const auto originY = psyqo::GTE::Short(tileHeight - camera.position.y);
-    const auto originZ =
-        psyqo::GTE::Short(psyqo::FixedPoint<>(z, 0) * Tile::SCALE - camera.position.z);
-
-    // FIXME: draw gt3s too!
 
-    for (std::size_t i = 0; i < gt4s.size(); ++i) {
-        auto v0 = verts[gt4Offset + i * 4 + 0];
-        v0.pos.x += originX;
-        v0.pos.y += originY;
-        v0.pos.z += originZ;
-
-        auto v1 = verts[gt4Offset + i * 4 + 1];
-        v1.pos.x += originX;
-        v1.pos.y += originY;
-        v1.pos.z += originZ;
-
-        auto v2 = verts[gt4Offset + i * 4 + 2];
-        v2.pos.x += originX;
-        v2.pos.y += originY;
-        v2.pos.z += originZ;
-
-        auto v3 = verts[gt4Offset + i * 4 + 3];
-        v3.pos.x += originX;
-        v3.pos.y += originY;
-        v3.pos.z += originZ;
+    auto* quadFragFog = tryAllocatePrim<psyqo::Prim::GouraudQuad>();
+    if (!quadFragFog) {
+        return;
+    }
 
-        const auto& prim = gt4s[i];
+    const auto level = getSubdivLevel(v0, v1, v2, v3);
+    if (level > 0 && canSubdivide<psyqo::Prim::GouraudTexturedQuad>(level)) {
+        auto& wrk = getSubdivData();
+        setTileSubdivCorners(wrk, tileIndex, tileInfo.height, camera);
+        for (auto& c : wrk.ocol) {
+            c = textureNeutral;
+        }
 
-        auto& quadFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-        auto& quadT = quadFragT.primitive;
+        psyqo::Prim::GouraudTexturedQuad quadT;
+        setTileQuadAttrs(quadT, tileInfo);
+        setSubdivAttrs(wrk, quadT);
+        quadT.setSemiTrans();
+        drawQuadSubdiv(quadT, level, avgZ, true);
+    } else if (auto* quadFragT = tryAllocatePrim<psyqo::Prim::GouraudTexturedQuad>()) {
+        auto& quadT = quadFragT->primitive;
+        setTileQuadAttrs(quadT, tileInfo);
+
+        quadT.pointA.packed = v0.sxy;
+        quadT.pointB.packed = v1.sxy;
+        quadT.pointC.packed = v2.sxy;
+        quadT.pointD.packed = v3.sxy;
+
+        quadT.setColorA(interpColor(textureNeutral, v0.p));
+        quadT.setColorB(interpColor(textureNeutral, v1.p));
+        quadT.setColorC(interpColor(textureNeutral, v2.p));
+        quadT.setColorD(interpColor(textureNeutral, v3.p));
         quadT.setSemiTrans();
 
-        quadT.tpage = prim.tpage;
-        quadT.clutIndex = prim.clutIndex;
-        quadT.uvA = prim.uvA;
-        quadT.uvB = prim.uvB;
-        quadT.uvC = prim.uvC;
-        quadT.uvD = prim.uvD;
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::Kernels::rtps();
-
-        quadT.setColorA(interpColorImm(textureNeutral));
+        insertPrim(ot, *quadFragT, avgZ);
+    }
 
-        uint32_t pa = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
+    auto& quadFog = quadFragFog->primitive;
 
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v1.pos);
-        psyqo::GTE::Kernels::rtps();
+    quadFog.pointA.packed = v0.sxy;
+    quadFog.pointB.packed = v1.sxy;
+    quadFog.pointC.packed = v2.sxy;
+    quadFog.pointD.packed = v3.sxy;
 
-        quadT.setColorB(interpColorImm(textureNeutral));
+    quadFog.setColorA(interpColorBack(fogColor, v0.p));
+    quadFog.setColorB(interpColorBack(fogColor, v1.p));
+    quadFog.setColorC(interpColorBack(fogColor, v2.p));
+    quadFog.setColorD(interpColorBack(fogColor, v3.p));
+    quadFog.setOpaque();
 
-        uint32_t pb = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
+    insertPrim(ot, *quadFragFog, avgZ);
+}
 
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v2.pos);
-        psyqo::GTE::Kernels::rtps();
+void Renderer::drawTileQuad(TileIndex tileIndex,
+    const TileInfo& tileInfo,
+    const Camera& camera,
+    const TransformedVertex& v0,
+    const TransformedVertex& v1,
+    const TransformedVertex& v2,
+    const TransformedVertex& v3)
+{
+    loadQuad(v0, v1, v2, v3);
+    psyqo::GTE::Kernels::nclip();
+    const auto dot = (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
+    if (dot < 0) {
+        ++frameStats.numCulledNclip;
+        return;
+    }
 
-        quadT.setColorC(interpColorImm(textureNeutral));
+    psyqo::GTE::Kernels::avsz4();
+    auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
+    if (avgZ == 0) { // cull
+        ++frameStats.numCulledDepth;
+        return;
+    }
 
-        uint32_t pc = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
+    avgZ = getLayerOTZ(avgZ, getTileLayer(tileInfo));
+    if (avgZ >= OT_SIZE) {
+        ++frameStats.numCulledDepth;
+        return;
+    }
 
-        psyqo::GTE::Kernels::nclip();
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            continue;
+    const auto level = getSubdivLevel(v0, v1, v2, v3);
+    if (level > 0 && canSubdivide<psyqo::Prim::GouraudTexturedQuad>(level)) {
+        auto& wrk = getSubdivData();
+        setTileSubdivCorners(wrk, tileIndex, tileInfo.height, camera);
+        for (auto& c : wrk.ocol) {
+            c = textureNeutral;
         }
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointA.packed);
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-        psyqo::GTE::Kernels::rtps();
+        psyqo::Prim::GouraudTexturedQuad quadT;
+        setTileQuadAttrs(quadT, tileInfo);
+        setSubdivAttrs(wrk, quadT);
+        drawQuadSubdiv(quadT, level, avgZ, false);
+        return;
+    }
 
-        quadT.setColorD(interpColorImm(textureNeutral));
+    auto* quadFragT = tryAllocatePrim<psyqo::Prim::GouraudTexturedQuad>();
+    if (!quadFragT) {
+        return;
+    }
 
-        uint32_t pd = psyqo::GTE::readRaw<psyqo::GTE::Register::IR0>();
+    auto& quadT = quadFragT->primitive;
+    setTileQuadAttrs(quadT, tileInfo);
 
-        psyqo::GTE::Kernels::avsz4();
+    quadT.pointA.packed = v0.sxy;
+    quadT.pointB.packed = v1.sxy;
+    quadT.pointC.packed = v2.sxy;
+    quadT.pointD.packed = v3.sxy;
 
-        auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
+    quadT.setColorA(textureNeutral);
+    quadT.setColorB(textureNeutral);
+    quadT.setColorC(textureNeutral);
+    quadT.setColorD(textureNeutral);
 
-        avgZ += floorBias;
+    insertPrim(getOrderingTable(), *quadFragT, avgZ);
+}
 
-        if (avgZ >= Renderer::OT_SIZE) {
-            continue;
-        }
+void Renderer::transformTileCorners(TileIndex tileIndex,
+    psyqo::FixedPoint<12, std::int16_t> height,
+    const Camera& camera,
+    bool fog,
+    TransformedVertex* vs)
+{
+    const auto corners = getTileCorners(tileIndex, height, camera);
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quadT.pointC.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quadT.pointD.packed);
+    psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V0>(corners[0]);
+    psyqo::GTE::writeUnsafe<psyqo::GTE::PseudoRegister::V1>(corners[1]);
+    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(corners[2]);
+    psyqo::GTE::Kernels::rtpt();
 
-        auto& quadFragFog = primBuffer.allocateFragment<psyqo::Prim::GouraudQuad>();
-        auto& quadFog = quadFragFog.primitive;
+    vs[0].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY0>();
+    vs[1].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY1>();
+    vs[2].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+    vs[0].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ1>();
+    vs[1].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ2>();
+    vs[2].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
 
-        quadFog.setColorA(interpColorBack(fogColor, pa));
-        quadFog.setColorB(interpColorBack(fogColor, pb));
-        quadFog.setColorC(interpColorBack(fogColor, pc));
-        quadFog.setColorD(interpColorBack(fogColor, pd));
+    psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(corners[3]);
+    psyqo::GTE::Kernels::rtps();
 
-        quadFog.pointA = quadT.pointA;
-        quadFog.pointB = quadT.pointB;
-        quadFog.pointC = quadT.pointC;
-        quadFog.pointD = quadT.pointD;
+    vs[3].sxy = psyqo::GTE::readRaw<psyqo::GTE::Register::SXY2>();
+    vs[3].sz = psyqo::GTE::readRaw<psyqo::GTE::Register::SZ3>();
 
-        ot.insert(quadFragT, avgZ);
-        ot.insert(quadFragFog, avgZ);
+    if (fog) {
+        for (int i = 0; i < 4; ++i) {
+            vs[i].p = getDepthCue(vs[i].sz);
+        }
     }
 }
 
-void Renderer::drawTileMesh(TileIndex tileIndex,
+void Renderer::drawTileFog(TileIndex tileIndex,
     const Tile& tile,
     const Tileset& tileset,
-    const MeshData& meshData,
+    const ModelData& tileMeshes,
     const Camera& camera)
 {
-    const int x = tileIndex.x;
-    const int z = tileIndex.z;
-
-    auto& ot = getOrderingTable();
-    auto& primBuffer = getPrimBuffer();
-
-    // mostly like drawMeshStatic, but moves each vertex into camera space without
-    // using rotation/translation registers
-    // - FIXME: remove copy-paste
-    const auto& g3s = meshData.g3;
-    const auto& g4s = meshData.g4;
-    const auto& gt3s = meshData.gt3;
-    const auto& gt4s = meshData.gt4;
-    const auto& verts = meshData.vertices;
-
-    const auto g4Offset = g3s.size() * 3;
-    const auto gt3Offset = g4Offset + g4s.size() * 4;
-    const auto gt4Offset = gt3Offset + gt3s.size() * 3;
-
     const auto& tileInfo = tileset.getTileInfo(tile.tileId);
-    const auto tileHeight = psyqo::FixedPoint<>(tileInfo.height);
-
-    const auto originX =
-        psyqo::GTE::Short(psyqo::FixedPoint<>(x, 0) * Tile::SCALE - camera.position.x);
-    const auto originY = psyqo::GTE::Short(tileHeight - camera.position.y);
-    const auto originZ =
-        psyqo::GTE::Short(psyqo::FixedPoint<>(z, 0) * Tile::SCALE - camera.position.z);
-
-    // FIXME: draw gt3s too!
-
-    for (std::size_t i = 0; i < gt4s.size(); ++i) {
-        auto v0 = verts[gt4Offset + i * 4 + 0];
-        v0.pos.x += originX;
-        v0.pos.y += originY;
-        v0.pos.z += originZ;
-
-        auto v1 = verts[gt4Offset + i * 4 + 1];
-        v1.pos.x += originX;
-        v1.pos.y += originY;
-        v1.pos.z += originZ;
-
-        auto v2 = verts[gt4Offset + i * 4 + 2];
-        v2.pos.x += originX;
-        v2.pos.y += originY;
-        v2.pos.z += originZ;
-
-        auto v3 = verts[gt4Offset + i * 4 + 3];
-        v3.pos.x += originX;
-        v3.pos.y += originY;
-        v3.pos.z += originZ;
-
-        const auto& prim = gt4s[i];
-
-        auto& quadFragT = primBuffer.allocateFragment<psyqo::Prim::GouraudTexturedQuad>();
-        auto& quadT = quadFragT.primitive;
-        quadT.tpage = prim.tpage;
-        quadT.clutIndex = prim.clutIndex;
-        quadT.uvA = prim.uvA;
-        quadT.uvB = prim.uvB;
-        quadT.uvC = prim.uvC;
-        quadT.uvD = prim.uvD;
-
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v0.pos);
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V1>(v1.pos);
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V2>(v2.pos);
-        psyqo::GTE::Kernels::rtpt();
-
-        // do while rtpt is doing this
-        quadT.setColorA(textureNeutral);
-        quadT.setColorB(textureNeutral);
-        quadT.setColorC(textureNeutral);
-        quadT.setColorD(textureNeutral);
-
-        psyqo::GTE::Kernels::nclip();
-        const auto dot =
-            (int32_t)psyqo::GTE::readRaw<psyqo::GTE::Register::MAC0, psyqo::GTE::Safe>();
-        if (dot < 0) {
-            continue;
-        }
+    const auto modelId = tileInfo.modelId;
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointA.packed);
+    if (modelId != TileInfo::NULL_MODEL_ID) { // "model" tiles
+        drawTileMeshFog(tileIndex, tile, tileset, tileMeshes.meshes[modelId], camera);
+        return;
+    }
 
-        psyqo::GTE::writeSafe<psyqo::GTE::PseudoRegister::V0>(v3.pos);
-        psyqo::GTE::Kernels::rtps();
+    eastl::array<TransformedVertex, 4> vs;
+    transformTileCorners(tileIndex, tileInfo.height, camera, true, vs.data());
+    drawTileQuadFog(tileIndex, tileInfo, camera, vs[0], vs[1], vs[2], vs[3]);
+}
 
-        psyqo::GTE::Kernels::avsz4();
+void Renderer::drawTile(TileIndex tileIndex,
+    const Tile& tile,
+    const Tileset& tileset,
+    const ModelData& tileMeshes,
+    const Camera& camera)
+{
+    const auto& tileInfo = tileset.getTileInfo(tile.tileId);
+    const auto modelId = tileInfo.modelId;
 
-        auto avgZ = psyqo::GTE::readRaw<psyqo::GTE::Register::OTZ, psyqo::GTE::Safe>();
-        if (avgZ == 0) { // cull
-            continue;
-        }
+    if (modelId != TileInfo::NULL_MODEL_ID) { // "model" tiles
+        drawTileMesh(tileIndex, tile, tileset, tileMeshes.meshes[modelId], camera);
+        return;
+    }
 
-        avgZ += floorBias;
+    eastl::array<TransformedVertex, 4> vs;
+    transformTileCorners(tileIndex, tileInfo.height, camera, false, vs.data());
+    drawTileQuad(tileIndex, tileInfo, camera, vs[0], vs[1], vs[2], vs[3]);
+}
 
-        psyqo::GTE::read<psyqo::GTE::Register::SXY0>(&quadT.pointB.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY1>(&quadT.pointC.packed);
-        psyqo::GTE::read<psyqo::GTE::Register::SXY2>(&quadT.pointD.packed);
+void Renderer::drawTileMeshFog(TileIndex tileIndex,
+    const Tile& tile,
+    const Tileset& tileset,
+    const MeshData& meshData,
+    const Camera& camera)
+{
+    const auto& tileInfo = tileset.getTileInfo(tile.tileId);
+    drawMeshImpl<MeshDrawPolicy{
+        .fog = true,
+        .fogOverlay = true,
+        .vertexColors = false,
+        .faceFlags = false,
+        .vertexSource = VertexSource::Tile,
+    }>(meshData,
+        getTileLayer(tileInfo),
+        nullptr,
+        getTileMeshOrigin(tileIndex, tileInfo, camera));
+}
 
-        ot.insert(quadFragT, avgZ);
-    }
+void Renderer::drawTileMesh(TileIndex tileIndex,
+    const Tile& tile,
+    const Tileset& tileset,
+    const MeshData& meshData,
+    const Camera& camera)
+{
+    const auto& tileInfo = tileset.getTileInfo(tile.tileId);
+    drawMeshImpl<MeshDrawPolicy{
+        .vertexColors = false,
+        .faceFlags = false,
+        .vertexSource = VertexSource::Tile,
+    }>(meshData,
+        getTileLayer(tileInfo),
+        nullptr,
+        getTileMeshOrigin(tileIndex, tileInfo, camera));
 }
 
 void Renderer::drawObjectAxes(const Object& object, const Camera& camera)
@@ -1793,6 +2038,16 @@ void Renderer::setFogNearFar(psyqo::FixedPoint<> near, psyqo::FixedPoint<> far)
 
     this->dqa = dqaF;
     this->dqb = dqbF;
+    fogFar = far;
+
+    updateDepthCueTable();
+    updateDepthMapping();
+}
+
+void Renderer::setFogEnabled(bool b)
+{
+    fogEnabled = b;
+    updateDepthMapping();
 }
 
 void Renderer::setFarColor(const psyqo::Color& c)
@@ -1802,7 +2057,7 @@ void Renderer::setFarColor(const psyqo::Color& c)
     psyqo::GTE::write<psyqo::GTE::Register::BFC, psyqo::GTE::Safe>(c.b);
 }
 
-uint32_t Renderer::calcInterpFactor(uint32_t sz)
+uint32_t Renderer::calcInterpFactor(uint32_t sz) const
 {
     // this is what GTE does when rtpt/rtps
     if (sz == 0) {
@@ -1813,59 +2068,109 @@ uint32_t Renderer::calcInterpFactor(uint32_t sz)
     if (div > 0x1FFFF) {
         div = 0x1FFFF;
     }
-    const auto mac0 = (div + 1) / 2 * dqa + dqb;
-    return mac0 / 0x1000;
+    const auto mac0 = (int32_t)((div + 1) / 2) * (int32_t)dqa + (int32_t)dqb;
+    return eastl::clamp(mac0 >> 12, 0, 0x1000); // IR0 is saturated to [0, 0x1000]
+}
+
+void Renderer::updateDepthCueTable()
+{
+    // The factor only saturates past fog's far when h is bigger than the one used for
+    // calculating dqa (see setFogNearFar), so the table covers twice the fog's range.
+    // The rest is calculated directly (see getDepthCue).
+    const auto maxSZ = (std::uint32_t)fogFar.value * 2;
+    depthCueShift = 0;
+    while ((maxSZ >> depthCueShift) >= DEPTH_CUE_TABLE_SIZE) {
+        ++depthCueShift;
+    }
+
+    for (std::uint32_t i = 0; i <= DEPTH_CUE_TABLE_SIZE; ++i) {
+        depthCueTable[i] = calcInterpFactor(i << depthCueShift);
+    }
+}
+
+void Renderer::updateDepthMapping()
+{
+    // faces which cross the far plane are only culled by depth when their average depth is
+    // twice as far
+    const auto farSZ = (std::uint32_t)(fogEnabled ? fogFar : VIEW_FAR).value * 2;
+    const auto maxOffset =
+        *eastl::max_element(DEPTH_LAYER_OFFSETS.begin(), DEPTH_LAYER_OFFSETS.end());
+    const auto rangeSZ = farSZ + (std::uint32_t)maxOffset.value;
+    static constexpr std::uint32_t numBuckets = OT_SIZE - OT_WORLD_BEGIN;
+
+    // avsz3/avsz4 calculate ZSF3 * (sz0 + sz1 + sz2) >> 12 / ZSF4 * (sz0 + ... + sz3) >> 12
+    const auto zsf3 = eastl::min((numBuckets << 12) / (rangeSZ * 3), 0x7FFFu);
+    const auto zsf4 = eastl::min((numBuckets << 12) / (rangeSZ * 4), 0x7FFFu);
+    psyqo::GTE::write<psyqo::GTE::Register::ZSF3, psyqo::GTE::Unsafe>(zsf3);
+    psyqo::GTE::write<psyqo::GTE::Register::ZSF4, psyqo::GTE::Unsafe>(zsf4);
+
+    for (std::size_t i = 0; i < DEPTH_LAYER_OFFSETS.size(); ++i) {
+        const auto offset = DEPTH_LAYER_OFFSETS[i].value;
+        auto bias = offset * (std::int32_t)numBuckets / (std::int32_t)rangeSZ;
+        if (offset < 0) { // must be in front of the world even with the lowest precision
+            bias = eastl::clamp(bias, -OT_WORLD_BEGIN, -1);
+        }
+        depthLayerBias[i] = OT_WORLD_BEGIN + bias;
+    }
 }
 
 void Renderer::setFOV(uint32_t nh)
 {
     h = nh;
     psyqo::GTE::write<psyqo::GTE::Register::H, psyqo::GTE::Unsafe>(h);
+
+    // side planes of the frustum go through (+-SCREEN_WIDTH / 2, h) and (+-SCREEN_HEIGHT / 2, h)
+    const auto calcSidePlaneNormal = [](std::int32_t h, std::int32_t halfSize) {
+        const auto len = (std::int32_t)math::isqrt(h * h + halfSize * halfSize);
+        return psyqo::Vec2{
+            .x = psyqo::FixedPoint<>((h << 12) / len, psyqo::FixedPoint<>::RAW),
+            .y = psyqo::FixedPoint<>((halfSize << 12) / len, psyqo::FixedPoint<>::RAW),
+        };
+    };
+    frustumSideX = calcSidePlaneNormal(h, SCREEN_WIDTH / 2);
+    frustumSideY = calcSidePlaneNormal(h, SCREEN_HEIGHT / 2);
+
+    updateDepthCueTable();
 }
 
-void Renderer::drawArmature(const AnimatedModelObject& object, const Camera& camera)
+void Renderer::drawArmature(AnimatedModelObject& object, const Camera& camera)
 {
-    calculateViewModelMatrix(object, camera, true);
-
     const auto& armature = object.model.armature;
     if (armature.joints.empty()) {
         return;
     }
+    const auto& jointViewTransforms = getJointViewTransforms(object, camera);
     const auto& rootJoint = armature.getRootJoint();
-    drawArmature(armature, object, rootJoint, rootJoint.firstChild);
+    drawArmature(armature, jointViewTransforms, rootJoint, rootJoint.firstChild);
 }
 
 void Renderer::drawArmature(const Armature& armature,
-    const AnimatedModelObject& object,
+    const eastl::vector<TransformMatrix>& jointViewTransforms,
     const Joint& joint,
     Joint::JointId childId)
 {
     using namespace psyqo::GTE;
-    using namespace psyqo::GTE::Math;
-    static constexpr auto L = PseudoRegister::Light;
-    static constexpr auto V0 = PseudoRegister::V0;
 
-    const auto& jt = object.jointGlobalTransforms[joint.id];
+    const auto& jt = jointViewTransforms[joint.id];
 
     static const auto boneStartL = psyqo::Vec3{};
     const auto boneEndL = (childId == Joint::NULL_JOINT_ID) ?
                               psyqo::Vec3{0.0, 0.1 / 8.0, 0.0} : // leaf bones have 0.1m length
                               armature.joints[childId].localTransform.translation;
 
-    writeSafe<PseudoRegister::Light>(jt.rotation);
-
-    const auto boneStartM = jt.transformPointMatrixLoaded<L, V0>(boneStartL);
-    const auto boneEndM = jt.transformPointMatrixLoaded<L, V0>(boneEndL);
+    // bones are in joint space
+    writeUnsafe<PseudoRegister::Rotation>(jt.rotation);
+    writeSafe<PseudoRegister::Translation>(jt.translation);
 
     const auto jointColor = (joint.id != armature.selectedJoint) ?
                                 psyqo::Color{.r = 255, .g = 255, .b = 128} :
                                 psyqo::Color{.r = 255, .g = 255, .b = 255};
-    drawLineLocalSpace(boneStartM, boneEndM, jointColor);
+    drawLineLocalSpace(boneStartL, boneEndL, jointColor);
 
     auto currentJointId = joint.firstChild;
     while (currentJointId != Joint::NULL_JOINT_ID) {
         auto& child = armature.joints[currentJointId];
-        drawArmature(armature, object, child, child.firstChild);
+        drawArmature(armature, jointViewTransforms, child, child.firstChild);
         currentJointId = child.nextSibling;
     }
 }
@@ -2,10 +2,9 @@
 
 #define PSYQO_RELEASE
 
+#include <EASTL/algorithm.h>
 #include <EASTL/array.h>
-#include <EASTL/bitset.h>
 
-#include <psyqo/bump-allocator.hh>
 #include <psyqo/gpu.hh>
 #include <psyqo/gte-kernels.hh>
 #include <psyqo/primitives/quads.hh>
@@ -13,7 +12,9 @@
 #include <psyqo/trigonometry.hh>
 
 #include <Graphics/Model.h>
+#include <Graphics/PrimRingBuffer.h>
 #include <Graphics/TextureInfo.h>
+#include <TileMap.h>
 
 struct MeshObject;
 struct ModelObject;
@@ -23,10 +24,6 @@ struct Circle;
 struct AABB;
 struct TimFile;
 
-struct TileIndex;
-struct Tile;
-struct Tileset;
-struct TileMap;
 
 class Renderer {
 public:
@@ -40,23 +37,53 @@ public:
         AnimatedModelObject& object,
         const Camera& camera,
         bool setViewRot = true);
-    void drawMeshArmature(
-        const AnimatedModelObject& object,
-        const Camera& camera,
-        const Armature& armature,
-        const Mesh& mesh);
+
+    // Screen-space box (relative to the screen's center) around the projected bounding spheres
+    // of an animated object's submeshes
+    struct ScreenExtent {
+        std::int32_t minX{0x7FFF};
+        std::int32_t minY{0x7FFF};
+        std::int32_t maxX{-0x7FFF};
+        std::int32_t maxY{-0x7FFF};
+        bool crossesNearPlane{false}; // the size can't be projected
+    };
+
+    // returns false if the mesh was culled, otherwise adds its bounding sphere to extent
+    bool drawMeshArmature(const eastl::vector<TransformMatrix>& jointViewTransforms,
+        Mesh& mesh,
+        ScreenExtent& extent);
+
+    // Returns V * M * J for each joint of the object.
+    // They're only calculated once per frame and shared by all submeshes and drawArmature.
+    const eastl::vector<TransformMatrix>& getJointViewTransforms(
+        AnimatedModelObject& object,
+        const Camera& camera);
 
     void drawMeshObject(MeshObject& object, const Camera& camera, bool setViewRot = true);
     void drawModelObject(ModelObject& object, const Camera& camera, bool setViewRot = true);
-    void drawModel(const Model& model);
-
-    void drawMeshFog(const MeshData& meshData);
-    void drawMesh(const MeshData& meshData);
-
-    void drawMeshStaticFog(const Mesh& mesh);
-    void drawMeshStatic(const Mesh& mesh);
-
-    void drawQuadSubdiv(const psyqo::Prim::GouraudTexturedQuad& quad2d, int avgZ, int addBias);
+    // distance is the view space depth of the model used for picking its LODs
+    void drawModel(Model& model, psyqo::FixedPoint<> distance);
+
+    enum class DepthLayer : std::uint8_t;
+
+    void drawMeshFog(const MeshData& meshData, DepthLayer layer);
+    void drawMesh(const MeshData& meshData, DepthLayer layer);
+
+    // Static meshes are drawn using their persistent packets (see Mesh::initPackets)
+    void drawMeshStaticFog(Mesh& mesh);
+    void drawMeshStatic(Mesh& mesh);
+
+    // Draw the face as a grid of smaller faces, so that affine texture mapping doesn't warp
+    // its texture as much (see Subdivision.h).
+    // The corners and their attributes need to be set in SubdivData before calling these.
+    void drawQuadSubdiv(const psyqo::Prim::GouraudTexturedQuad& prim,
+        int level,
+        int avgZ,
+        bool fog);
+    void drawTriangleSubdiv(const psyqo::Prim::GouraudTexturedTriangle& prim,
+        int level,
+        int avgZ,
+        bool fog);
 
     void drawTiles(const ModelData& tileModels, const TileMap& tileMap, const Camera& camera);
 
@@ -88,17 +115,82 @@ public:
         const MeshData& mesh,
         const Camera& camera);
 
-    static constexpr auto OT_SIZE = 4096 * 2;
+    // avsz3/avsz4 map the view depth range of the scene (see updateDepthMapping)
+    // to buckets [OT_WORLD_BEGIN, OT_SIZE)
+    static constexpr auto OT_SIZE = 4096;
+    // buckets before it are used by the layers which are drawn over the world (see DepthLayer)
+    static constexpr int OT_WORLD_BEGIN = 16;
     using OrderingTableType = psyqo::OrderingTable<OT_SIZE>;
     eastl::array<OrderingTableType, 2> ots;
 
-    // TODO: can make much smaller once static geometry stores primitives on heap
-    static constexpr int PRIMBUFFLEN = 32768 * 10;
-    using PrimBufferAllocatorType = psyqo::BumpAllocator<PRIMBUFFLEN>;
-    eastl::array<PrimBufferAllocatorType, 2> primBuffers;
+    // Early submission (off by default): buckets from OT_FAR_BEGIN go to a separate OT which
+    // is chained as soon as the far part of the scene is drawn (see chainFarPass), so the GPU
+    // can start on it while the rest of the frame is still being built
+    bool earlySubmit{false};
+    static constexpr int OT_FAR_BEGIN = OT_SIZE / 2;
+    using FarOrderingTableType = psyqo::OrderingTable<OT_SIZE - OT_FAR_BEGIN>;
+    eastl::array<FarOrderingTableType, 2> farOts;
+
+    // Each layer pushes its prims back by some view space distance before they're sorted,
+    // e.g. floor tiles are always drawn under the objects which stand on them.
+    enum class DepthLayer : std::uint8_t {
+        Overlay, // drawn over everything at the same depth (e.g. fog fade rects)
+        Character,
+        World,
+        Floor,
+        FloorLow, // pavements: drawn under the rest of the floor
+        Count,
+    };
+
+    // OT bucket of prims in the layer with the given average depth (calculated by avsz3/avsz4)
+    int getLayerOTZ(int otz, DepthLayer layer) const
+    {
+        return otz + depthLayerBias[(std::size_t)layer];
+    }
+
+    // static geometry stores its primitives in Mesh::packets, so this only needs to
+    // fit tiles, dynamic objects and subdivided quads of two frames
+    // (see getPeakUsage/getPeakFrameUsage)
+    static constexpr int PRIMBUFFLEN = 32768 * 8;
+    using PrimBufferAllocatorType = PrimRingBuffer<PRIMBUFFLEN>;
+    PrimBufferAllocatorType primBuffer;
+
+    // Primitives which can be skipped when the prim buffer is almost full (see tryAllocatePrim)
+    // leave this much space for the ones which can't (UI, fade rects, etc.)
+    static constexpr std::size_t PRIMBUFF_RESERVE = 8 * 1024;
 
     OrderingTableType& getOrderingTable() { return ots[gpu.getParity()]; }
-    PrimBufferAllocatorType& getPrimBuffer() { return primBuffers[gpu.getParity()]; }
+    FarOrderingTableType& getFarOrderingTable() { return farOts[gpu.getParity()]; }
+    // Chains the far OT (only used with earlySubmit), called once per frame before
+    // the main OT. Everything inserted after it goes into the main OT.
+    void chainFarPass();
+    PrimBufferAllocatorType& getPrimBuffer() { return primBuffer; }
+    // must be called before anything is allocated from the prim buffer during the frame
+    void beginFrame();
+
+    // Per-frame counters which are used to size PRIMBUFFLEN and OT_SIZE
+    struct FrameStats {
+        // allocated with allocateFragment, by PrimStatsType
+        eastl::array<std::uint32_t, (std::size_t)PrimStatsType::Count> primBytes{};
+        std::uint32_t primBufferUsed{0};
+
+        int numPrimsInserted{0};
+        int numCulledNclip{0}; // back faces
+        int numCulledDepth{0}; // behind the near plane or past the end of the OT
+        int numPrimsSkipped{0}; // not drawn because the prim buffer was full
+        // earlySubmit: prims past OT_FAR_BEGIN which were inserted after the far pass was chained
+        // (they're drawn after all of it, so they aren't sorted against it)
+        int numLateFarPrims{0};
+
+        // min/max OT bucket which anything was inserted into
+        int minOTZ{OT_SIZE};
+        int maxOTZ{-1};
+    };
+
+    // stats of the last finished frame
+    const FrameStats& getLastFrameStats() const { return lastFrameStats; }
+    // max value of each counter (min for minOTZ) since the start
+    const FrameStats& getPeakFrameStats() const { return peakFrameStats; }
 
     psyqo::GPU& getGPU() { return gpu; }
 
@@ -107,7 +199,12 @@ public:
         const Camera& camera,
         bool setViewRot = true);
 
-    int bias{0};
+    // Screen coords and depth of a vertex (see transformVertices)
+    struct TransformedVertex {
+        std::uint32_t sxy;
+        std::uint16_t sz;
+        std::uint16_t p; // depth cue factor (only calculated when drawing with fog)
+    };
 
     void drawObjectAxes(const Object& object, const Camera& camera);
 
@@ -137,15 +234,30 @@ public:
 
     void drawCircle(const Camera& camera, const Circle& circle, const psyqo::Color& c);
 
-    void drawArmature(const AnimatedModelObject& object, const Camera& camera);
+    void drawArmature(AnimatedModelObject& object, const Camera& camera);
 
     void setFogNearFar(psyqo::FixedPoint<> near, psyqo::FixedPoint<> far);
     void setFarColor(const psyqo::Color& c);
-    uint32_t calcInterpFactor(uint32_t sz);
+
+    // Depth cue factor (0 - near, 0x1000 - far) which GTE calculates into IR0 when
+    // transforming a vertex with the given screen depth.
+    // Interpolated from a table which is rebuilt in setFogNearFar and setFOV, so it's cheap
+    // enough for per-vertex use (e.g. after rtpt, which only sets IR0 for the last vertex).
+    std::uint32_t getDepthCue(std::uint32_t sz) const
+    {
+        const auto i = sz >> depthCueShift;
+        if (i >= DEPTH_CUE_TABLE_SIZE) {
+            return calcInterpFactor(sz);
+        }
+        const int a = depthCueTable[i];
+        const int b = depthCueTable[i + 1];
+        const int frac = sz & ((1 << depthCueShift) - 1);
+        return a + (((b - a) * frac) >> depthCueShift);
+    }
 
     void setFOV(uint32_t nh);
 
-    void setFogEnabled(bool b) { fogEnabled = b; };
+    void setFogEnabled(bool b);
     bool isFogEnabled() const { return fogEnabled; }
 
     void setFogColor(psyqo::Color c) { fogColor = c; }
@@ -154,43 +266,238 @@ public:
     psyqo::Color fogColor = psyqo::Color{.r = 108, .g = 100, .b = 116};
 
     int numTilesDrawn{0};
-
-    // size of the tile visibility bitfield (MAX_TILES_DIM * MAX_TILES_DIM)
-    static constexpr auto MAX_TILES_DIM = 32;
+    int numObjectsCulled{0};
 
 private:
-    bool shouldCullObject(const Object& object, const Camera& camera) const;
-    void calculateTileVisibility(const Camera& camera);
+    enum class VertexSource {
+        Mesh, // transformed with R and T which are currently set in GTE
+        Tile, // tile space, moved into camera space by the tile's origin (T is 0)
+    };
+
+    // Compile-time options of drawMeshImpl.
+    // All mesh drawing functions are its variants, each one only has the code it needs.
+    struct MeshDrawPolicy {
+        bool fog{false};
+        // Draw the face semi-trans with neutral colors and an untextured fog overlay under it
+        // instead of interpolating the face's colors to the fog color
+        bool fogOverlay{false};
+        // use Mesh::packets instead of allocating prims from the prim buffer
+        bool staticPackets{false};
+        bool subdivide{true};
+        // use the mesh's vertex colors (otherwise faces are drawn with neutral color)
+        bool vertexColors{true};
+        // use the additional bias and double-sidedness stored in the face's padding
+        bool faceFlags{true};
+        VertexSource vertexSource{VertexSource::Mesh};
+    };
+
+    // packets are only used for P.staticPackets, origin - for VertexSource::Tile
+    template<MeshDrawPolicy P>
+    void drawMeshImpl(const MeshData& meshData,
+        DepthLayer layer,
+        MeshPackets* packets = nullptr,
+        psyqo::GTE::PackedVec3 origin = {});
+    template<MeshDrawPolicy P, bool IsQuad>
+    void drawMeshFaces(const MeshData& meshData,
+        const TransformedVertex* vs,
+        int layerBias,
+        MeshPackets* packets,
+        psyqo::GTE::PackedVec3 origin);
+
+    // Transforms each unique vertex of the mesh once.
+    // The result is stored in the scratchpad (or in vertexCache if the mesh is too big)
+    template<MeshDrawPolicy P>
+    TransformedVertex* transformVertices(const MeshData& meshData, psyqo::GTE::PackedVec3 origin);
+
+    // Extends the fog fade rect of the animated model (see drawAnimatedModelObject)
+    // to cover the face (pass the last vertex twice for triangles)
+    void updateFadeRect(const TransformedVertex& v0,
+        const TransformedVertex& v1,
+        const TransformedVertex& v2,
+        const TransformedVertex& v3);
+
+    // Returns the row of tile corners at the given height, only transforming them
+    // if they're not already cached (see drawTiles)
+    const TransformedVertex* getTileCornerRow(int z,
+        psyqo::FixedPoint<12, std::int16_t> height,
+        int baseX,
+        int minIndex,
+        int maxIndex,
+        const Camera& camera,
+        bool fog);
+
+    void transformTileCorners(TileIndex tileIndex,
+        psyqo::FixedPoint<12, std::int16_t> height,
+        const Camera& camera,
+        bool fog,
+        TransformedVertex* vs);
+
+    // Draw flat tiles from the already transformed corners
+    void drawTileQuadFog(TileIndex tileIndex,
+        const TileInfo& tileInfo,
+        const Camera& camera,
+        const TransformedVertex& v0,
+        const TransformedVertex& v1,
+        const TransformedVertex& v2,
+        const TransformedVertex& v3);
+    void drawTileQuad(TileIndex tileIndex,
+        const TileInfo& tileInfo,
+        const Camera& camera,
+        const TransformedVertex& v0,
+        const TransformedVertex& v1,
+        const TransformedVertex& v2,
+        const TransformedVertex& v3);
+
+    // Inserts the primitive into the current OT and updates frameStats
+    // (z is clamped to the OT, the stats record the bucket which is actually used)
+    template<typename Frag>
+    void insertPrim(OrderingTableType& ot, Frag& frag, int z)
+    {
+        const auto bucket = eastl::clamp(z, 0, OT_SIZE - 1);
+        if (earlySubmit && bucket >= OT_FAR_BEGIN) {
+            if (!farPassChained) {
+                getFarOrderingTable().insert(frag, bucket - OT_FAR_BEGIN);
+            } else {
+                // the main OT's buckets past OT_FAR_BEGIN are otherwise empty,
+                // so late prims are still drawn before everything closer
+                ot.insert(frag, bucket);
+                ++frameStats.numLateFarPrims;
+            }
+        } else {
+            ot.insert(frag, bucket);
+        }
+        ++frameStats.numPrimsInserted;
+        frameStats.minOTZ = eastl::min(frameStats.minOTZ, bucket);
+        frameStats.maxOTZ = eastl::max(frameStats.maxOTZ, bucket);
+    }
+
+    // Allocates a primitive which can be skipped when the prim buffer is almost full.
+    // Returns nullptr in that case.
+    template<typename P>
+    psyqo::Fragments::SimpleFragment<P>* tryAllocatePrim()
+    {
+        auto* frag = primBuffer.tryAllocateFragment<P>(PRIMBUFF_RESERVE);
+        if (!frag) {
+            ++frameStats.numPrimsSkipped;
+        }
+        return frag;
+    }
+
+    // Returns false if the subdivided face wouldn't fit into the prim buffer
+    // (it's drawn without subdivision then)
+    template<typename P>
+    bool canSubdivide(int level) const
+    {
+        const auto numSubPrims = 1u << (level * 2);
+        return primBuffer.hasSpace(
+            numSubPrims * sizeof(psyqo::Fragments::SimpleFragment<P>), PRIMBUFF_RESERVE);
+    }
+
+    psyqo::Vec3 toViewSpace(const Object& object,
+        const psyqo::Vec3& point,
+        const Camera& camera) const;
+    // center is in view space
+    bool isSphereOutsideFrustum(const psyqo::Vec3& center, psyqo::FixedPoint<> radius) const;
+    bool shouldCullObject(const Object& object,
+        const MeshBounds& bounds,
+        const Camera& camera) const;
+    void calculateTileVisibility(const Camera& camera, const TileMap& tileMap);
+
+    // Returns the LOD of the mesh which should be drawn at the given view space depth
+    // (mesh.lod is updated)
+    const MeshData& selectLod(Mesh& mesh, psyqo::FixedPoint<> distance) const;
 
     psyqo::GPU& gpu;
     psyqo::Trig<> trig;
 
+    FrameStats frameStats;
+    FrameStats lastFrameStats;
+    FrameStats peakFrameStats;
+
     void drawArmature(
         const Armature& armature,
-        const AnimatedModelObject& object,
+        const eastl::vector<TransformMatrix>& jointViewTransforms,
         const Joint& joint,
         Joint::JointId childId);
 
+    // Emulates what GTE does to calculate IR0 during rtps (slow: uses division)
+    uint32_t calcInterpFactor(uint32_t sz) const;
+
     std::uint32_t dqa{};
     std::uint32_t dqb{};
+
+    // Depth cue factors for sz = i << depthCueShift. Rebuilt when dqa, dqb or h change.
+    void updateDepthCueTable();
+    static constexpr std::uint32_t DEPTH_CUE_TABLE_SIZE = 256;
+    eastl::array<std::uint16_t, DEPTH_CUE_TABLE_SIZE + 1> depthCueTable{};
+    int depthCueShift{0};
     std::uint32_t h{300};
+    psyqo::FixedPoint<> fogFar{1.0};
+
+    // Sets ZSF3/ZSF4 and depthLayerBias for the current far distance.
+    // Called when the fog's far distance changes or fog is enabled/disabled.
+    void updateDepthMapping();
+    // how far back each DepthLayer is pushed (in view space)
+    static constexpr eastl::array<psyqo::FixedPoint<>, (std::size_t)DepthLayer::Count>
+        DEPTH_LAYER_OFFSETS{
+            psyqo::FixedPoint<>(-0.002), // Overlay
+            psyqo::FixedPoint<>(0.0), // Character
+            psyqo::FixedPoint<>(0.0), // World
+            psyqo::FixedPoint<>(0.5), // Floor
+            psyqo::FixedPoint<>(0.6875), // FloorLow
+        };
+    // DEPTH_LAYER_OFFSETS in OT buckets (+ OT_WORLD_BEGIN)
+    eastl::array<int, (std::size_t)DepthLayer::Count> depthLayerBias{};
+
+    // near and far (when fog is disabled) distance used for frustum culling
+    static constexpr auto VIEW_NEAR = psyqo::FixedPoint<>(0.03);
+    static constexpr auto VIEW_FAR = psyqo::FixedPoint<>(4.0);
+
+    // how far past the LOD switching distance the mesh has to be to switch LODs
+    static constexpr auto LOD_HYSTERESIS = psyqo::FixedPoint<>(0.0625);
+
+    // normals of the frustum's side planes (calculated in setFOV):
+    // (+-frustumSideX.x, 0, -frustumSideX.y) and (0, +-frustumSideY.x, -frustumSideY.y)
+    psyqo::Vec2 frustumSideX;
+    psyqo::Vec2 frustumSideY;
 
     bool fogEnabled{true};
 
+    // set by chainFarPass, reset in beginFrame
+    bool farPassChained{false};
+
     // used to draw a "fade rect" when doing fog for dynamic objects
-    // calculated while drawing prims in drawMeshFog
-    uint32_t minAvgZ;
-    uint32_t minAvgP;
+    // calculated while drawing prims in drawMeshFog (minAvgZ doesn't include the layer's bias)
+    static constexpr uint32_t MIN_AVG_Z_UNSET = 0xFFFFF;
+    uint32_t minAvgZ{MIN_AVG_Z_UNSET};
+    uint32_t minAvgP{0};
     int16_t minSX;
     int16_t minSY;
     int16_t maxSX;
     int16_t maxSY;
 
-    // min/max tile visible in the current frame
-    int minTileX, maxTileX;
-    int minTileZ, maxTileZ;
-
-    // Tiles which can be seen by the camera
-    // Stored in relative coordinates to the minimum point of frustum's AABB in XZ plane
-    eastl::bitset<MAX_TILES_DIM * MAX_TILES_DIM> tileSeen;
+    // Tile map chunk which can be seen by the camera
+    struct VisibleTileChunk {
+        int minX, minZ; // index of the chunk's top-left tile
+        const TileMap::Chunk* tiles;
+        // bit i of rows[z] is set if tile (minX + i, minZ + z) is seen
+        eastl::array<std::uint16_t, TileMap::CHUNK_SIZE> rows{};
+    };
+    eastl::vector<VisibleTileChunk> visibleTileChunks;
+
+    // used by transformVertices for meshes which don't fit into the scratchpad
+    eastl::vector<TransformedVertex> vertexCache;
+
+    // Row of transformed tile corners (tile (x, z) has corners (x, z)..(x + 1, z + 1))
+    struct TileCornerRow {
+        int z{INT16_MAX};
+        int baseX{0}; // x of the corner at index 0
+        psyqo::FixedPoint<12, std::int16_t> height{};
+        int minIndex{0};
+        int maxIndex{-1};
+        TransformedVertex* corners{nullptr}; // points into the scratchpad
+    };
+    static constexpr auto TILE_CORNER_ROW_SIZE = TileMap::CHUNK_SIZE + 1;
+    // two rows of corners (top and bottom of the current tile row), indexed by z & 1
+    eastl::array<TileCornerRow, 2> tileCornerRows;
 };
@@ -1,136 +1,447 @@
 #include "SkeletalAnimation.h"
 
+#include <EASTL/algorithm.h>
 #include <EASTL/fixed_string.h>
 #include <common/syscalls/syscalls.h>
 #include <psyqo/xprintf.h>
 
 #include <Core/FileReader.h>
+#include <Core/ScratchPad.h>
 #include <Graphics/Armature.h>
+#include <Math/Math.h>
 
 namespace
 {
+// Rotations are blended in batches (see animateArmature)
+constexpr std::size_t MAX_SCRATCHPAD_BLENDS = SCRATCH_PAD_SIZE / sizeof(QuaternionBlend);
+
+// "ANMC" - compressed animations. Old files start with the number of animations instead.
+constexpr std::uint32_t COMPRESSED_ANIM_MAGIC = 0x434D4E41;
+
+// 4.12 component = (s * QUAT_COMPONENT_SCALE) >> 10, maps +-511 to +-1/sqrt(2)
+constexpr std::int32_t QUAT_COMPONENT_SCALE = 5799;
+constexpr std::int32_t PACKED_COMPONENT_MAX = 511;
+
+// 1 / n in 20.12 - segments are almost always shorter than this, so sampling doesn't divide
+constexpr int MAX_RECIPROCAL = 64;
+struct ReciprocalTable {
+    std::uint16_t values[MAX_RECIPROCAL + 1];
+};
+
+constexpr ReciprocalTable makeReciprocalTable()
+{
+    ReciprocalTable table{};
+    for (int i = 1; i <= MAX_RECIPROCAL; ++i) {
+        table.values[i] = 4096 / i;
+    }
+    return table;
+}
+
+constexpr auto RECIPROCALS = makeReciprocalTable();
+
+psyqo::FixedPoint<> getReciprocal(int n)
+{
+    if (n <= MAX_RECIPROCAL) {
+        return psyqo::FixedPoint<>(RECIPROCALS.values[n], psyqo::FixedPoint<>::RAW);
+    }
+    return psyqo::FixedPoint<>(1.0) / psyqo::FixedPoint<>(n, 0);
+}
+
 psyqo::FixedPoint<> lerp(psyqo::FixedPoint<> a, psyqo::FixedPoint<> b, psyqo::FixedPoint<> factor)
 {
     return a * factor + (psyqo::FixedPoint<>(1.0) - factor) * b;
 }
 
+std::int32_t iabs(std::int32_t v)
+{
+    return v < 0 ? -v : v;
 }
 
-void animateArmature(
-    Armature& armature,
-    const SkeletalAnimation& animation,
-    psyqo::FixedPoint<> normalizedAnimTime)
+std::int32_t unpackComponent(std::uint32_t packed, int shift)
 {
-    const auto currentFrame = normalizedAnimTime * psyqo::FixedPoint<>(animation.length, 0);
-    for (const auto& track : animation.tracks) {
-        auto& joint = armature.joints[track.joint];
+    // sign extend 10 bits
+    return (std::int32_t)(packed << (22 - shift)) >> 22;
+}
+
+std::uint32_t packComponent(std::int32_t v, int shift)
+{
+    v = eastl::clamp(v, -PACKED_COMPONENT_MAX, PACKED_COMPONENT_MAX);
+    return ((std::uint32_t)v & 0x3FF) << shift;
+}
+
+Quaternion unpackRotation(std::uint32_t packed)
+{
+    std::int32_t c[4];
+    const int largest = packed >> 30;
+    std::int32_t sumSq = 0;
+    int shift = 20;
+    for (int i = 0; i < 4; ++i) {
+        if (i == largest) {
+            continue;
+        }
+        c[i] = (unpackComponent(packed, shift) * QUAT_COMPONENT_SCALE) >> 10;
+        sumSq += c[i] * c[i];
+        shift -= 10;
+    }
+    c[largest] = math::isqrt(eastl::max(4096 * 4096 - sumSq, 0));
+
+    Quaternion q;
+    q.w.value = c[0];
+    q.x.value = c[1];
+    q.y.value = c[2];
+    q.z.value = c[3];
+    return q;
+}
+
+std::uint32_t packRotation(const Quaternion& q)
+{
+    const std::int32_t c[4] = {q.w.value, q.x.value, q.y.value, q.z.value};
+    int largest = 0;
+    for (int i = 1; i < 4; ++i) {
+        if (iabs(c[i]) > iabs(c[largest])) {
+            largest = i;
+        }
+    }
+    // q and -q are the same rotation, the largest component is stored as positive
+    const std::int32_t sign = (c[largest] < 0) ? -1 : 1;
+
+    std::uint32_t packed = (std::uint32_t)largest << 30;
+    int shift = 20;
+    for (int i = 0; i < 4; ++i) {
+        if (i == largest) {
+            continue;
+        }
+        const auto v = sign * c[i] * 1024;
+        const auto rounding = (v < 0 ? -QUAT_COMPONENT_SCALE : QUAT_COMPONENT_SCALE) / 2;
+        packed |= packComponent((v + rounding) / QUAT_COMPONENT_SCALE, shift);
+        shift -= 10;
+    }
+    return packed;
+}
+
+psyqo::Vector<4, 12, std::int16_t> unpackTranslation(const AnimationTrack& track,
+    std::uint32_t packed)
+{
+    psyqo::Vector<4, 12, std::int16_t> tr{};
+    tr.x.value = track.base[0] + (unpackComponent(packed, 20) << track.shift);
+    tr.y.value = track.base[1] + (unpackComponent(packed, 10) << track.shift);
+    tr.z.value = track.base[2] + (unpackComponent(packed, 0) << track.shift);
+    return tr;
+}
+
+std::uint32_t packTranslation(const AnimationTrack& track,
+    const psyqo::Vector<4, 12, std::int16_t>& tr)
+{
+    return packComponent((tr.x.value - track.base[0]) >> track.shift, 20) |
+           packComponent((tr.y.value - track.base[1]) >> track.shift, 10) |
+           packComponent((tr.z.value - track.base[2]) >> track.shift, 0);
+}
+
+AnimationValue unpackValue(const AnimationTrack& track, std::uint32_t packed)
+{
+    AnimationValue value;
+    if (track.info == TRACK_TYPE_ROTATION) {
+        value.rotation = unpackRotation(packed);
+    } else {
+        value.translation = unpackTranslation(track, packed);
+    }
+    return value;
+}
+
+void decodeSegment(const SkeletalAnimation& animation,
+    const AnimationTrack& track,
+    TrackCursor& cursor)
+{
+    const auto* values = animation.getValues(track);
+    cursor.prev = unpackValue(track, values[cursor.key]);
+    cursor.next = unpackValue(track, values[cursor.key + 1]);
+
+    if (track.info == TRACK_TYPE_ROTATION) {
+        // interpolate along the shortest path
+        const auto& a = cursor.prev.rotation;
+        auto& b = cursor.next.rotation;
+        const auto dot = a.w.value * b.w.value + a.x.value * b.x.value +
+                         a.y.value * b.y.value + a.z.value * b.z.value;
+        if (dot < 0) {
+            b.w = -b.w;
+            b.x = -b.x;
+            b.y = -b.y;
+            b.z = -b.z;
+        }
+    }
+}
+
+// Returns the index of the key which starts the segment containing frame.
+// The cursor is moved from the previously sampled key, so it only takes a few steps
+// during normal playback (backwards for reversed animations and when looped ones wrap).
+std::uint16_t findSegment(const std::uint16_t* frames,
+    int numKeys,
+    psyqo::FixedPoint<> frame,
+    std::uint16_t cursor)
+{
+    const int lastSegment = numKeys - 2;
+    int i = eastl::min((int)cursor, lastSegment);
+    while (i < lastSegment && frame >= psyqo::FixedPoint<>(frames[i + 1], 0)) {
+        ++i;
+    }
+    while (i > 0 && frame < psyqo::FixedPoint<>(frames[i], 0)) {
+        --i;
+    }
+    return i;
+}
+
+// Appends the packed keys of the track to animation.data
+template<typename T>
+std::uint32_t appendData(SkeletalAnimation& animation, const T* arr, std::size_t numElements)
+{
+    const auto offset = animation.data.size();
+    const auto size = (numElements * sizeof(T) + 3) & ~3; // keep 4 byte alignment
+    animation.data.resize(offset + size);
+    memcpy(&animation.data[offset], arr, numElements * sizeof(T));
+    return offset;
+}
+
+void addTrack(SkeletalAnimation& animation,
+    AnimationTrack& track,
+    const eastl::vector<std::uint16_t>& frames,
+    const eastl::vector<std::uint32_t>& values)
+{
+    track.numKeys = frames.size();
+    if (track.numKeys == 0 ||
+        (track.info != TRACK_TYPE_ROTATION && track.info != TRACK_TYPE_TRANSLATION)) {
+        return; // scale tracks aren't supported
+    }
+    if (track.numKeys == 1) {
+        ConstantTrack constantTrack{
+            .info = track.info,
+            .joint = track.joint,
+        };
+        constantTrack.data = unpackValue(track, values[0]);
+        animation.constantTracks.push_back(constantTrack);
+        return;
+    }
+
+    track.framesOffset = appendData(animation, frames.data(), frames.size());
+    track.valuesOffset = appendData(animation, values.data(), values.size());
+    animation.tracks.push_back(track);
+}
+
+// The whole file is stored the same way as it's stored in memory, only constant tracks
+// are moved out.
+void loadCompressedAnimations(util::FileReader& fr, eastl::vector<SkeletalAnimation>& animations)
+{
+    eastl::vector<std::uint16_t> frames;
+    eastl::vector<std::uint32_t> values;
+
+    const auto numAnimations = fr.GetUInt32();
+    for (int j = 0; j < numAnimations; ++j) {
+        SkeletalAnimation animation;
+        animation.name.value = fr.GetUInt32();
+        animation.flags = fr.GetUInt32();
+        animation.length = fr.GetUInt16();
+        animation.numTracks = fr.GetUInt16();
+        animation.tracks.reserve(animation.numTracks);
+        for (int i = 0; i < animation.numTracks; ++i) {
+            AnimationTrack track;
+            track.info = fr.GetUInt8();
+            track.joint = fr.GetUInt8();
+            const auto numKeys = fr.GetUInt16();
+            track.shift = fr.GetUInt8();
+            fr.SkipBytes(1); // pad
+            track.base[0] = fr.GetInt16();
+            track.base[1] = fr.GetInt16();
+            track.base[2] = fr.GetInt16();
 
-        if (track.keys.size() == 1) { // constant track.
-                                      // TODO: don't even include it in this list?
-            if (track.info == TRACK_TYPE_ROTATION) {
-                joint.localTransform.rotation = track.keys[0].data.rotation;
-                continue;
-            } else {
-                const auto& tr = track.keys[0].data.translation;
-                joint.localTransform.translation.x = psyqo::FixedPoint<>(tr.x);
-                joint.localTransform.translation.y = psyqo::FixedPoint<>(tr.y);
-                joint.localTransform.translation.z = psyqo::FixedPoint<>(tr.z);
-                continue;
+            frames.resize(numKeys);
+            fr.ReadArr(frames.data(), numKeys);
+            if (numKeys % 2 != 0) {
+                fr.SkipBytes(2); // pad
             }
+            values.resize(numKeys);
+            fr.ReadArr(values.data(), numKeys);
+
+            addTrack(animation, track, frames, values);
         }
+        animations.push_back(eastl::move(animation));
+    }
+}
+
+// Old format: frame (int32 20.12) + full rotation (4 x int16) or translation (4 x int16)
+// for each key. Keys are packed the same way model_converter does it.
+void loadUncompressedAnimations(util::FileReader& fr,
+    eastl::vector<SkeletalAnimation>& animations)
+{
+    eastl::vector<std::uint16_t> frames;
+    eastl::vector<std::uint32_t> values;
+    eastl::vector<psyqo::Vector<4, 12, std::int16_t>> translations;
+
+    const auto numAnimations = fr.GetUInt32();
+    for (int j = 0; j < numAnimations; ++j) {
+        SkeletalAnimation animation;
+        animation.name.value = fr.GetUInt32();
+        animation.flags = fr.GetUInt32();
+        animation.length = fr.GetUInt16();
+        animation.numTracks = fr.GetUInt16();
+        animation.tracks.reserve(animation.numTracks);
+        for (int i = 0; i < animation.numTracks; ++i) {
+            AnimationTrack track{};
+            track.info = fr.GetUInt8();
+            track.joint = fr.GetUInt8();
+            const auto numKeys = fr.GetUInt16();
+
+            frames.clear();
+            values.clear();
+            translations.clear();
+            for (int k = 0; k < numKeys; ++k) {
+                psyqo::FixedPoint<> frame;
+                frame.value = fr.GetInt32();
+                frames.push_back(frame.integer());
+                if (track.info == TRACK_TYPE_ROTATION) {
+                    Quaternion rotation;
+                    rotation.w.value = fr.GetInt16();
+                    rotation.x.value = fr.GetInt16();
+                    rotation.y.value = fr.GetInt16();
+                    rotation.z.value = fr.GetInt16();
+                    values.push_back(packRotation(rotation));
+                } else if (track.info == TRACK_TYPE_TRANSLATION) {
+                    psyqo::Vector<4, 12, std::int16_t> tr{};
+                    tr.x.value = fr.GetInt16();
+                    tr.y.value = fr.GetInt16();
+                    tr.z.value = fr.GetInt16();
+                    fr.SkipBytes(2);
+                    translations.push_back(tr);
+                }
+            }
+
+            if (track.info == TRACK_TYPE_TRANSLATION && numKeys > 0) {
+                // deltas from the first key, shifted until all of them fit into 10 bits
+                const auto& first = translations[0];
+                track.base[0] = first.x.value;
+                track.base[1] = first.y.value;
+                track.base[2] = first.z.value;
 
-        // TODO: use binary search instead
-        int nextKeyIdx;
-        for (nextKeyIdx = track.keys.size() - 1; nextKeyIdx >= 0; nextKeyIdx--) {
-            if (currentFrame >= track.keys[nextKeyIdx - 1].frame) {
-                break;
+                std::int32_t maxDelta = 0;
+                for (const auto& tr : translations) {
+                    maxDelta = eastl::max(maxDelta, iabs(tr.x.value - track.base[0]));
+                    maxDelta = eastl::max(maxDelta, iabs(tr.y.value - track.base[1]));
+                    maxDelta = eastl::max(maxDelta, iabs(tr.z.value - track.base[2]));
+                }
+                track.shift = 0;
+                while ((maxDelta >> track.shift) > PACKED_COMPONENT_MAX) {
+                    ++track.shift;
+                }
+
+                for (const auto& tr : translations) {
+                    values.push_back(packTranslation(track, tr));
+                }
             }
+
+            addTrack(animation, track, frames, values);
+        }
+        animations.push_back(eastl::move(animation));
+    }
+}
+
+}
+
+void animateArmature(
+    Armature& armature,
+    const SkeletalAnimation& animation,
+    psyqo::FixedPoint<> normalizedAnimTime,
+    eastl::vector<TrackCursor>& trackCursors)
+{
+    for (const auto& track : animation.constantTracks) {
+        auto& joint = armature.joints[track.joint];
+        if (track.info == TRACK_TYPE_ROTATION) {
+            joint.localTransform.rotation = track.data.rotation;
+        } else {
+            const auto& tr = track.data.translation;
+            joint.localTransform.translation.x = psyqo::FixedPoint<>(tr.x);
+            joint.localTransform.translation.y = psyqo::FixedPoint<>(tr.y);
+            joint.localTransform.translation.z = psyqo::FixedPoint<>(tr.z);
         }
-        if (nextKeyIdx == -1) {
-            nextKeyIdx = 1;
+    }
+
+    if (trackCursors.size() != animation.tracks.size()) {
+        trackCursors.clear();
+        trackCursors.resize(animation.tracks.size());
+    }
+
+    // Rotation tracks are collected in the scratchpad and nlerp'ed all at once
+    auto* blends = (QuaternionBlend*)SCRATCH_PAD;
+    std::size_t numBlends = 0;
+
+    const auto currentFrame = normalizedAnimTime * psyqo::FixedPoint<>(animation.length, 0);
+    for (std::size_t i = 0; i < animation.tracks.size(); ++i) {
+        const auto& track = animation.tracks[i];
+        auto& joint = armature.joints[track.joint];
+        auto& cursor = trackCursors[i];
+
+        const auto* frames = animation.getFrames(track);
+        const auto prevKeyIdx = findSegment(frames, track.numKeys, currentFrame, cursor.key);
+        if (prevKeyIdx != cursor.key) {
+            cursor.key = prevKeyIdx;
+            decodeSegment(animation, track, cursor);
         }
-        const auto& prevKey = track.keys[nextKeyIdx - 1];
-        const auto& nextKey = track.keys[nextKeyIdx];
+        const auto& prevKey = cursor.prev;
+        const auto& nextKey = cursor.next;
 
 #define DO_LERP
 
 #ifdef DO_LERP
-        // TODO: precompute 1 / (nextKey.frame - prevKey.frame) ?
-        auto lerpFactor = (nextKey.frame - currentFrame) / (nextKey.frame - prevKey.frame);
+        const auto nextFrame = frames[prevKeyIdx + 1];
+        auto lerpFactor = (psyqo::FixedPoint<>(nextFrame, 0) - currentFrame) *
+                          getReciprocal(nextFrame - frames[prevKeyIdx]);
 #endif
 
         if (track.info == TRACK_TYPE_ROTATION) {
 #ifndef DO_LERP
-            joint.localTransform.rotation = prevKey.data.rotation;
+            joint.localTransform.rotation = prevKey.rotation;
 #else
-            joint.localTransform.rotation =
-                slerp(prevKey.data.rotation, nextKey.data.rotation, lerpFactor);
+            blends[numBlends++] = {
+                prevKey.rotation, nextKey.rotation, lerpFactor, &joint.localTransform.rotation};
+            if (numBlends == MAX_SCRATCHPAD_BLENDS) {
+                nlerp(blends, numBlends);
+                numBlends = 0;
+            }
 #endif
         } else if (track.info == TRACK_TYPE_TRANSLATION) {
 #ifndef DO_LERP
-            const auto& tr = prevKey.data.translation;
+            const auto& tr = prevKey.translation;
             joint.localTransform.translation.x = psyqo::FixedPoint<>(tr.x);
             joint.localTransform.translation.y = psyqo::FixedPoint<>(tr.y);
             joint.localTransform.translation.z = psyqo::FixedPoint<>(tr.z);
 #else
             joint.localTransform.translation.x = lerp(
-                psyqo::FixedPoint<>(prevKey.data.translation.x),
-                psyqo::FixedPoint<>(nextKey.data.translation.x),
+                psyqo::FixedPoint<>(prevKey.translation.x),
+                psyqo::FixedPoint<>(nextKey.translation.x),
                 lerpFactor);
             joint.localTransform.translation.y = lerp(
-                psyqo::FixedPoint<>(prevKey.data.translation.y),
-                psyqo::FixedPoint<>(nextKey.data.translation.y),
+                psyqo::FixedPoint<>(prevKey.translation.y),
+                psyqo::FixedPoint<>(nextKey.translation.y),
                 lerpFactor);
             joint.localTransform.translation.z = lerp(
-                psyqo::FixedPoint<>(prevKey.data.translation.z),
-                psyqo::FixedPoint<>(nextKey.data.translation.z),
+                psyqo::FixedPoint<>(prevKey.translation.z),
+                psyqo::FixedPoint<>(nextKey.translation.z),
                 lerpFactor);
 #endif
         }
     }
+    nlerp(blends, numBlends);
 }
 
 void loadAnimations(
     const eastl::vector<uint8_t>& data,
     eastl::vector<SkeletalAnimation>& animations)
 {
-    // vertices
     util::FileReader fr{
         .bytes = data.data(),
     };
 
-    const auto numAnimations = fr.GetUInt32();
-    for (int j = 0; j < numAnimations; ++j) {
-        SkeletalAnimation animation;
-        animation.name.value = fr.GetUInt32();
-        animation.flags = fr.GetUInt32();
-        animation.length = fr.GetUInt16();
-        animation.numTracks = fr.GetUInt16();
-        animation.tracks.reserve(animation.numTracks);
-        for (int i = 0; i < animation.numTracks; ++i) {
-            AnimationTrack track;
-            track.info = fr.GetUInt8();
-            track.joint = fr.GetUInt8();
-            const auto numKeys = fr.GetUInt16();
-            track.keys.reserve(numKeys);
-            for (int j = 0; j < numKeys; ++j) {
-                AnimationKey key{};
-                key.frame.value = fr.GetInt32();
-                if (track.info == TRACK_TYPE_ROTATION) {
-                    key.data.rotation.w.value = fr.GetInt16();
-                    key.data.rotation.x.value = fr.GetInt16();
-                    key.data.rotation.y.value = fr.GetInt16();
-                    key.data.rotation.z.value = fr.GetInt16();
-                } else if (track.info == TRACK_TYPE_TRANSLATION) {
-                    key.data.translation.x.value = fr.GetInt16();
-                    key.data.translation.y.value = fr.GetInt16();
-                    key.data.translation.z.value = fr.GetInt16();
-                    fr.SkipBytes(2);
-                }
-                track.keys.push_back(eastl::move(key));
-            }
-            animation.tracks.push_back(eastl::move(track));
-        }
-        animations.push_back(eastl::move(animation));
+    if (fr.GetObj<std::uint32_t>() == COMPRESSED_ANIM_MAGIC) {
+        loadCompressedAnimations(fr, animations);
+    } else {
+        fr.cursor = 0;
+        loadUncompressedAnimations(fr, animations);
     }
 }
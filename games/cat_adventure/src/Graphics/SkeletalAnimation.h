@@ -14,24 +14,53 @@
 struct Armature;
 struct TransformMatrix;
 
-struct AnimationKey {
-    psyqo::FixedPoint<> frame;
-    union
-    {
-        psyqo::Vector<4, 12, std::int16_t> translation;
-        Quaternion rotation;
-    } data;
+union AnimationValue
+{
+    AnimationValue() : translation{} {}
+
+    psyqo::Vector<4, 12, std::int16_t> translation;
+    Quaternion rotation;
 };
 
 static constexpr uint8_t TRACK_TYPE_ROTATION = 0;
 static constexpr uint8_t TRACK_TYPE_TRANSLATION = 1;
 static constexpr uint8_t TRACK_TYPE_SCALE = 2;
 
+// Keys are stored packed in SkeletalAnimation::data:
+// frames - one uint16 per key (frame indices)
+// values - one uint32 per key:
+//     rotation - "smallest three": index of the largest component (in w, x, y, z order)
+//         in the top two bits, the other three components as signed 10-bit values
+//         (+-511 is +-1/sqrt(2)). The largest component is always positive.
+//     translation - x, y, z as signed 10-bit deltas from base, multiplied by (1 << shift)
 struct AnimationTrack {
     std::uint8_t info; // first two bytes - type (00 - rot, 01 - trans, 10 - scale)
     std::uint8_t joint;
-    std::uint16_t _pad{}; // {} to stop GCC from complaining about uninitialized var
-    eastl::vector<AnimationKey> keys;
+    std::uint8_t shift;
+    std::uint8_t _pad{}; // {} to stop GCC from complaining about uninitialized var
+    std::uint16_t numKeys; // always at least two
+    std::int16_t base[3];
+    std::uint32_t framesOffset;
+    std::uint32_t valuesOffset;
+};
+
+// Track with only one key - its value is set every frame without sampling
+struct ConstantTrack {
+    std::uint8_t info; // same as AnimationTrack::info
+    std::uint8_t joint;
+    std::uint16_t _pad{};
+    AnimationValue data;
+};
+
+// Sampling state of one track: the last sampled segment and its decoded keys.
+// Keys are only decoded when the segment changes.
+struct TrackCursor {
+    static constexpr std::uint16_t NO_KEY = 0xFFFF;
+
+    std::uint16_t key{NO_KEY}; // first key of the segment
+    std::uint16_t _pad{};
+    AnimationValue prev;
+    AnimationValue next;
 };
 
 struct SkeletalAnimation {
@@ -40,15 +69,32 @@ struct SkeletalAnimation {
     std::uint8_t numTracks;
     std::uint16_t length;
     eastl::vector<AnimationTrack> tracks;
+    eastl::vector<ConstantTrack> constantTracks;
+    eastl::vector<std::uint8_t> data; // packed keys of all tracks
+
+    const std::uint16_t* getFrames(const AnimationTrack& track) const
+    {
+        return reinterpret_cast<const std::uint16_t*>(&data[track.framesOffset]);
+    }
+    const std::uint32_t* getValues(const AnimationTrack& track) const
+    {
+        return reinterpret_cast<const std::uint32_t*>(&data[track.valuesOffset]);
+    }
 
     bool isLooped() const { return (flags & 1) != 0; }
 };
 
+// Loads both the compressed (written by the current model_converter) and the old format
+// (keys are packed on load)
 void loadAnimations(
     const eastl::vector<uint8_t>& data,
     eastl::vector<SkeletalAnimation>& animations);
 
+// trackCursors - sampling state of each track of the animation.
+// Sampling starts the search from the last sampled key, so playback only moves
+// by a key or so per frame.
 void animateArmature(
     Armature& armature,
     const SkeletalAnimation& animation,
-    psyqo::FixedPoint<> normalizedAnimTime);
+    psyqo::FixedPoint<> normalizedAnimTime,
+    eastl::vector<TrackCursor>& trackCursors);
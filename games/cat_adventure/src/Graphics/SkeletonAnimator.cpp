@@ -2,6 +2,7 @@
 
 #include <Graphics/Model.h>
 
+#include <EASTL/algorithm.h>
 #include <common/syscalls/syscalls.h>
 
 #include <Game.h>
@@ -22,7 +23,10 @@ void SkeletonAnimator::setAnimation(StringHash animationName,
     }
 
     currentAnimation = anim;
+    currentBakedAnimation =
+        bakedAnimations ? bakedAnimations->findAnimation(animationName) : nullptr;
     this->playbackSpeed = playbackSpeed;
+    trackCursors.clear();
 
     if (startAnimationPoint == 0.0) {
         if (playbackSpeed > 0.0) {
@@ -115,7 +119,7 @@ bool SkeletonAnimator::frameJustChanged() const
 }
 
 void SkeletonAnimator::animate(Armature& armature,
-    eastl::vector<TransformMatrix>& jointGlobalTransforms) const
+    eastl::vector<TransformMatrix>& jointGlobalTransforms)
 {
     if (armature.joints.empty()) {
         return;
@@ -126,5 +130,20 @@ void SkeletonAnimator::animate(Armature& armature,
     }
 
     const auto& animation = *currentAnimation;
-    animateArmature(armature, animation, normalizedAnimTime);
+    animateArmature(armature, animation, normalizedAnimTime, trackCursors);
+}
+
+bool SkeletonAnimator::getBakedPose(eastl::vector<TransformMatrix>& jointGlobalTransforms) const
+{
+    if (!currentBakedAnimation) {
+        return false;
+    }
+
+    const auto& baked = *currentBakedAnimation;
+    const auto frame = normalizedAnimTime * psyqo::FixedPoint<>(currentAnimation->length, 0) +
+                       psyqo::FixedPoint<>(0.5); // nearest frame
+    const auto frameIdx = eastl::min(frame.integer(), baked.numFrames - 1);
+    const auto* pose = baked.getPose(frameIdx);
+    eastl::copy(pose, pose + baked.numJoints, jointGlobalTransforms.begin());
+    return true;
 }
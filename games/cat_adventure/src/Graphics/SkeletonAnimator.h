@@ -3,6 +3,7 @@
 #include <EASTL/vector.h>
 
 #include <Core/StringHash.h>
+#include <Graphics/BakedAnimation.h>
 #include <Graphics/SkeletalAnimation.h>
 
 struct SkeletonAnimator {
@@ -16,7 +17,10 @@ struct SkeletonAnimator {
     const SkeletalAnimation* findAnimation(StringHash animationName) const;
 
     void update();
-    void animate(Armature& armature, eastl::vector<TransformMatrix>& jointGlobalTransforms) const;
+    void animate(Armature& armature, eastl::vector<TransformMatrix>& jointGlobalTransforms);
+    // Copies the current frame's pose into jointGlobalTransforms if the current animation
+    // is baked (armature's joints are not changed then), returns false otherwise
+    bool getBakedPose(eastl::vector<TransformMatrix>& jointGlobalTransforms) const;
 
     int getAnimationFrame() const;
     bool frameJustChanged() const;
@@ -34,7 +38,9 @@ struct SkeletonAnimator {
 
     // data
     eastl::vector<SkeletalAnimation>* animations{nullptr};
+    const BakedAnimations* bakedAnimations{nullptr}; // optional
     const SkeletalAnimation* currentAnimation{nullptr};
+    const BakedAnimation* currentBakedAnimation{nullptr};
     psyqo::FixedPoint<> normalizedAnimTime{0.0};
 
     void pauseAnimation() { animationPaused = true; }
@@ -45,6 +51,9 @@ private:
 
     psyqo::FixedPoint<> playbackSpeed{1.0};
 
+    // sampling state of each track of the current animation (see animateArmature)
+    eastl::vector<TrackCursor> trackCursors;
+
     uint32_t currentTimeMcs{0};
     uint32_t animLengthMcs{0};
 
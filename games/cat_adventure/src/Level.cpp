@@ -60,7 +60,6 @@ void Level::loadNewFormat(const eastl::vector<uint8_t>& data)
     collisionBoxes.clear();
     triggers.clear();
     staticObjects.clear();
-    modelData.meshes.clear();
     tileMap.tileset.tiles.clear();
 
     util::FileReader fr{
@@ -97,6 +96,7 @@ void Level::loadNewFormat(const eastl::vector<uint8_t>& data)
 
         std::uint16_t meshIndex = fr.GetInt16();
         object.mesh = modelData.meshes[meshIndex].makeInstance();
+        object.mesh.initPackets();
 
         // yaw (stored as 4.12, convert to 22.10)
         const auto yaw = psyqo::Angle{fr.GetInt16() >> 2, psyqo::Angle::RAW};
@@ -172,4 +172,7 @@ void Level::loadNewFormat(const eastl::vector<uint8_t>& data)
 
         triggers.push_back(eastl::move(trigger));
     }
+
+    tileMap.load(fr);
+    ramsyscall_printf("num tile chunks: %d\n", (int)tileMap.chunks.size());
 }
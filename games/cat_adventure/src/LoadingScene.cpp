@@ -20,8 +20,8 @@ void LoadingScene::draw(Renderer& renderer)
     const auto parity = gpu().getParity();
     auto& ot = renderer.ots[parity];
 
-    auto& primBuffer = renderer.primBuffers[parity];
-    primBuffer.reset();
+    renderer.beginFrame();
+    auto& primBuffer = renderer.getPrimBuffer();
     // fill bg
     psyqo::Color bg{{.r = 0, .g = 0, .b = 0}};
     auto& fill = primBuffer.allocateFragment<psyqo::Prim::FastFill>();
@@ -171,6 +171,25 @@ psyqo::Angle atan2(psyqo::FixedPoint<> y, psyqo::FixedPoint<> x)
     return res;
 }
 
+std::uint32_t isqrt(std::uint32_t v)
+{
+    std::uint32_t res = 0;
+    std::uint32_t bit = 1u << 30;
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return res;
+}
+
 psyqo::FixedPoint<> distanceSq(const psyqo::Vec3& a, const psyqo::Vec3& b)
 {
     auto aMinusB = a - b;
@@ -13,6 +13,9 @@ psyqo::Angle calculateLerpDelta(psyqo::Angle a, psyqo::Angle b, psyqo::Angle spe
 
 psyqo::FixedPoint<> distanceSq(const psyqo::Vec3& a, const psyqo::Vec3& b);
 
+// floor(sqrt(v)), slow - don't use every frame
+std::uint32_t isqrt(std::uint32_t v);
+
 psyqo::Angle atan2(psyqo::FixedPoint<> y, psyqo::FixedPoint<> x);
 
 // TODO: gte lerp
@@ -1,13 +1,67 @@
 #include "Quaternion.h"
 
-#include <psyqo/soft-math.hh>
-
+#include <EASTL/algorithm.h>
 #include <EASTL/fixed_string.h>
 #include <common/syscalls/syscalls.h>
 #include <psyqo/gte-kernels.hh>
 #include <psyqo/gte-registers.hh>
 #include <psyqo/xprintf.h>
 
+namespace
+{
+// 1 / sqrt(m / 4096) in 2.14 for m in [1024, 4096) - the value for the middle of each 32 wide range
+constexpr int INV_SQRT_TABLE_SIZE = 96;
+struct InvSqrtTable {
+    std::uint16_t values[INV_SQRT_TABLE_SIZE];
+};
+
+constexpr std::uint32_t constexprSqrt(std::uint64_t v)
+{
+    std::uint32_t res = 0;
+    for (int bit = 31; bit >= 0; --bit) {
+        const auto candidate = res | (1u << bit);
+        if ((std::uint64_t)candidate * candidate <= v) {
+            res = candidate;
+        }
+    }
+    return res;
+}
+
+constexpr InvSqrtTable makeInvSqrtTable()
+{
+    InvSqrtTable table{};
+    for (int i = 0; i < INV_SQRT_TABLE_SIZE; ++i) {
+        const std::uint64_t m = (i + 32) * 32 + 16;
+        table.values[i] = constexprSqrt((1ull << 40) / m);
+    }
+    return table;
+}
+
+constexpr auto INV_SQRT_TABLE = makeInvSqrtTable();
+
+std::int32_t iabs(std::int32_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+// 1 / sqrt(s) in 2.14, s has 24 fractional bits and must be in [0.25, 4)
+std::int32_t inverseSqrt(std::int32_t s)
+{
+    // the table covers [0.25, 1), s in [1, 4) is looked up as s / 4
+    auto m = s >> 12;
+    int shift = 0;
+    if (s >= (1 << 24)) {
+        m = s >> 14;
+        shift = 1;
+    }
+    const std::int32_t r = INV_SQRT_TABLE.values[(m >> 5) - 32] >> shift;
+
+    // one Newton-Raphson step (the table is within 0.8%): r * (3 - s * r * r) / 2
+    const auto srr = ((std::uint32_t)(s >> 10) * (std::uint32_t)((r * r) >> 14)) >> 16; // 20.12
+    return eastl::min((r * (3 * 4096 - (std::int32_t)srr)) >> 13, 32767);
+}
+}
+
 psyqo::Matrix33 Quaternion::toRotationMatrix() const
 {
     const auto x2 = x * x;
@@ -40,77 +94,97 @@ Quaternion operator*(const Quaternion& q1, const Quaternion& q2)
     };
 }
 
-psyqo::FixedPoint<12, std::int16_t> lerp(psyqo::FixedPoint<> a,
-    psyqo::FixedPoint<> b,
-    psyqo::FixedPoint<> factor)
-{
-    /* return psyqo::FixedPoint<12, std::int16_t>(
-        a * factor + (psyqo::FixedPoint<>(1.0) - factor) * b); */
-    return psyqo::FixedPoint<12, std::int16_t>(
-        (psyqo::FixedPoint<>(1.0) - factor) * a + b * factor);
-}
-
 /* static eastl::fixed_string<char, 512> str;
 fsprintf(str, "s = %.4f, 1/sqrt(s) = %.4f", s, r);
 ramsyscall_printf("%s\n", str.c_str()); */
 
 void Quaternion::normalize()
 {
-    auto x = psyqo::FixedPoint<>(this->x);
-    auto y = psyqo::FixedPoint<>(this->y);
-    auto z = psyqo::FixedPoint<>(this->z);
-    auto w = psyqo::FixedPoint<>(this->w);
-
-    // sq = (x*x, y*y, z*z)
-    psyqo::GTE::write<psyqo::GTE::Register::IR1, psyqo::GTE::Unsafe>(x.value);
-    psyqo::GTE::write<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>(y.value);
-    psyqo::GTE::write<psyqo::GTE::Register::IR3, psyqo::GTE::Safe>(z.value);
-    psyqo::GTE::Kernels::sqr();
-    psyqo::Vec3 sq;
-    psyqo::GTE::read<psyqo::GTE::PseudoRegister::LV>(sq);
-
-    // s = x * x + y * y + z * z + w * w
-    const auto s = sq.x + sq.y + sq.z + w * w;
-
-    // r = 1 / sqrt(s)
-    psyqo::GTE::write<psyqo::GTE::Register::LZCS, psyqo::GTE::Safe>(s.raw());
-    const auto approx = 1 << (psyqo::GTE::readRaw<psyqo::GTE::Register::LZCR>() - 9);
-    const auto approxFP = psyqo::FixedPoint<>(approx, psyqo::FixedPoint<>::RAW);
-    const auto r = psyqo::SoftMath::inverseSquareRoot(s, approxFP);
-
-    /*
-        x *= r;
-        y *= r;
-        z *= r;
-    */
-    psyqo::GTE::write<psyqo::GTE::Register::IR0, psyqo::GTE::Unsafe>(r.value);
-    psyqo::GTE::write<psyqo::GTE::Register::IR1, psyqo::GTE::Unsafe>(x.value);
-    psyqo::GTE::write<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>(y.value);
-    psyqo::GTE::write<psyqo::GTE::Register::IR3, psyqo::GTE::Safe>(z.value);
-    psyqo::GTE::Kernels::gpf();
-    x.value = psyqo::GTE::readRaw<psyqo::GTE::Register::IR1, psyqo::GTE::Safe>();
-    y.value = psyqo::GTE::readRaw<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>();
-    z.value = psyqo::GTE::readRaw<psyqo::GTE::Register::IR3, psyqo::GTE::Unsafe>();
-
-    w *= r;
-
-    this->x = psyqo::FixedPoint<12, std::int16_t>(x);
-    this->y = psyqo::FixedPoint<12, std::int16_t>(y);
-    this->z = psyqo::FixedPoint<12, std::int16_t>(z);
-    this->w = psyqo::FixedPoint<12, std::int16_t>(w);
+    std::int32_t c[4] = {w.value, x.value, y.value, z.value};
+    std::int32_t maxAbs = 0;
+    for (const auto v : c) {
+        maxAbs = eastl::max(maxAbs, iabs(v));
+    }
+    if (maxAbs == 0) {
+        *this = Quaternion{};
+        return;
+    }
+
+    // Scale by a power of two so that the largest component is in [0.5, 1):
+    // the squares don't lose bits for short quaternions and don't overflow for long ones,
+    // and the squared length is always in [0.25, 4)
+    psyqo::GTE::write<psyqo::GTE::Register::LZCS, psyqo::GTE::Safe>(maxAbs);
+    const int shift = (int)psyqo::GTE::readRaw<psyqo::GTE::Register::LZCR>() - 20;
+    for (auto& v : c) {
+        v = (shift >= 0) ? (v << shift) : (v >> -shift);
+    }
+
+    // s = w * w + x * x + y * y + z * z (unshifted - 24 fractional bits)
+    psyqo::GTE::write<psyqo::GTE::Register::IR1, psyqo::GTE::Unsafe>(c[1]);
+    psyqo::GTE::write<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>(c[2]);
+    psyqo::GTE::write<psyqo::GTE::Register::IR3, psyqo::GTE::Safe>(c[3]);
+    psyqo::GTE::Kernels::sqr<psyqo::GTE::Kernels::SF::Unshifted>();
+    const std::int32_t xx = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC1, psyqo::GTE::Safe>();
+    const std::int32_t yy = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC2, psyqo::GTE::Unsafe>();
+    const std::int32_t zz = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC3, psyqo::GTE::Unsafe>();
+    const auto s = c[0] * c[0] + xx + yy + zz;
+
+    const auto r = inverseSqrt(s);
+
+    // (x, y, z) *= r - unshifted, so that r can keep 14 fractional bits
+    psyqo::GTE::write<psyqo::GTE::Register::IR0, psyqo::GTE::Unsafe>(r);
+    psyqo::GTE::write<psyqo::GTE::Register::IR1, psyqo::GTE::Unsafe>(c[1]);
+    psyqo::GTE::write<psyqo::GTE::Register::IR2, psyqo::GTE::Unsafe>(c[2]);
+    psyqo::GTE::write<psyqo::GTE::Register::IR3, psyqo::GTE::Safe>(c[3]);
+    psyqo::GTE::Kernels::gpf<psyqo::GTE::Kernels::SF::Unshifted>();
+    const std::int32_t rx = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC1, psyqo::GTE::Safe>();
+    const std::int32_t ry = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC2, psyqo::GTE::Unsafe>();
+    const std::int32_t rz = psyqo::GTE::readRaw<psyqo::GTE::Register::MAC3, psyqo::GTE::Unsafe>();
+
+    // 2.14 * 4.12 -> 4.12 (rounded)
+    w.value = (c[0] * r + (1 << 13)) >> 14;
+    x.value = (rx + (1 << 13)) >> 14;
+    y.value = (ry + (1 << 13)) >> 14;
+    z.value = (rz + (1 << 13)) >> 14;
 }
 
-Quaternion slerp(const Quaternion& q1, const Quaternion& q2, psyqo::FixedPoint<> factor)
+namespace
 {
-    Quaternion res;
+// (a + (b - a) * factor) on raw 4.12 values, factor is in 20.12
+std::int16_t lerpRaw(std::int32_t a, std::int32_t b, std::int32_t factor)
+{
+    return a + (((b - a) * factor + (1 << 11)) >> 12);
+}
 
-    res.x = lerp(psyqo::FixedPoint<>(q1.x), psyqo::FixedPoint<>(q2.x), factor);
-    res.y = lerp(psyqo::FixedPoint<>(q1.y), psyqo::FixedPoint<>(q2.y), factor);
-    res.z = lerp(psyqo::FixedPoint<>(q1.z), psyqo::FixedPoint<>(q2.z), factor);
-    res.w = lerp(psyqo::FixedPoint<>(q1.w), psyqo::FixedPoint<>(q2.w), factor);
+Quaternion nlerpUnnormalized(const Quaternion& q1, const Quaternion& q2, std::int32_t factor)
+{
+    // q and -q are the same rotation: blend towards the one in q1's hemisphere
+    const auto dot = q1.w.value * q2.w.value + q1.x.value * q2.x.value +
+                     q1.y.value * q2.y.value + q1.z.value * q2.z.value;
+    const std::int32_t sign = (dot < 0) ? -1 : 1;
 
-    // FIXME: it's kinda broken...
-    // res.normalize();
+    Quaternion res;
+    res.w.value = lerpRaw(q1.w.value, sign * q2.w.value, factor);
+    res.x.value = lerpRaw(q1.x.value, sign * q2.x.value, factor);
+    res.y.value = lerpRaw(q1.y.value, sign * q2.y.value, factor);
+    res.z.value = lerpRaw(q1.z.value, sign * q2.z.value, factor);
+    return res;
+}
+}
 
+Quaternion nlerp(const Quaternion& q1, const Quaternion& q2, psyqo::FixedPoint<> factor)
+{
+    auto res = nlerpUnnormalized(q1, q2, factor.value);
+    res.normalize();
     return res;
 }
+
+void nlerp(const QuaternionBlend* blends, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& blend = blends[i];
+        auto& res = *blend.out;
+        res = nlerpUnnormalized(blend.q1, blend.q2, blend.factor.value);
+        res.normalize();
+    }
+}
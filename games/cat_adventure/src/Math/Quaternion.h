@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 #include <psyqo/fixed-point.hh>
@@ -14,5 +15,18 @@ struct Quaternion {
 
 Quaternion operator*(const Quaternion& q1, const Quaternion& q2);
 
-/* Works for small rotations only for now - okay for animation interpolation */
-Quaternion slerp(const Quaternion& q1, const Quaternion& q2, psyqo::FixedPoint<> factor);
+// Normalized lerp: takes the shortest path (q2 is flipped to q1's hemisphere if needed).
+// Not constant speed like slerp, but the difference is invisible for animation keys.
+Quaternion nlerp(const Quaternion& q1, const Quaternion& q2, psyqo::FixedPoint<> factor);
+
+struct QuaternionBlend {
+    Quaternion q1;
+    Quaternion q2;
+    psyqo::FixedPoint<> factor;
+    Quaternion* out;
+};
+
+// *blend.out = nlerp(blend.q1, blend.q2, blend.factor) for all blends.
+// Does the same work as calling nlerp for each of them (see tools/quatbench for the error
+// and cycle estimates).
+void nlerp(const QuaternionBlend* blends, std::size_t count);
@@ -119,15 +119,10 @@ void AnimatedModelObject::update(std::uint32_t dt)
     calculateWorldMatrix();
     animator.update();
 
-    animator.animate(model.armature, jointGlobalTransforms);
-
-    if (useManualHeadRotation) {
-        auto& rot = model.armature.joints[4].localTransform.rotation;
-        rot = manualHeadRotation;
+    if (updatePose) {
+        calculatePose();
     }
 
-    model.armature.calculateTransforms(jointGlobalTransforms);
-
     if (faceSubmeshIdx != 0xFF) {
         blinkTimer.update();
         if (!isInBlink) {
@@ -159,6 +154,23 @@ void AnimatedModelObject::update(std::uint32_t dt)
     }
 }
 
+void AnimatedModelObject::calculatePose()
+{
+    // baked poses can't have the head rotated manually
+    if (!useManualHeadRotation && animator.getBakedPose(jointGlobalTransforms)) {
+        return;
+    }
+
+    animator.animate(model.armature, jointGlobalTransforms);
+
+    if (useManualHeadRotation) {
+        auto& rot = model.armature.joints[4].localTransform.rotation;
+        rot = manualHeadRotation;
+    }
+
+    model.armature.calculateTransforms(jointGlobalTransforms);
+}
+
 void AnimatedModelObject::setFaceAnimation(std::uint8_t faceU, std::uint8_t faceV)
 {
     if (faceSubmeshIdx == 0xFF) {
@@ -121,10 +121,21 @@ inline constexpr StringHash SHOCKED_FACE_ANIMATION = "Shocked"_sh;
 struct AnimatedModelObject : ModelObject {
     void updateCollision();
     void update(std::uint32_t dt);
+    void calculatePose();
 
     eastl::vector<TransformMatrix> jointGlobalTransforms;
+    // V * M * J for each joint, cached by Renderer once per frame (see getJointViewTransforms)
+    eastl::vector<TransformMatrix> jointViewTransforms;
+    std::uint32_t jointViewTransformsFrame{0xFFFFFFFF};
     SkeletonAnimator animator;
 
+    // Set by Renderer::drawAnimatedModelObject, used by AnimationScheduler:
+    // approximate radius on screen in pixels, 0 if the object wasn't visible
+    static constexpr std::int16_t SCREEN_RADIUS_UNKNOWN = 0x7FFF;
+    std::int16_t screenRadius{SCREEN_RADIUS_UNKNOWN};
+    // whether the pose is calculated in update (see AnimationScheduler)
+    bool updatePose{true};
+
     std::uint8_t faceSubmeshIdx{0xFF};
     std::uint8_t faceOffsetU{0};
     std::uint8_t faceOffsetV{0};
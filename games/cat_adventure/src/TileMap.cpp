@@ -1,45 +1,55 @@
 #include <TileMap.h>
 
-Tile TileMap::getTile(TileIndex ti) const
-{
-    auto x = ti.x;
-    auto z = ti.z;
-
-    Tile info{
-        .tileId = 3, // grass
-    };
+#include <psyqo/kernel.hh>
 
-    if (z == 0) {
-        info.tileId = 1; // road with stripe
-    }
+#include <Core/FileReader.h>
 
-    if (z == -1 || z == -2 || z == -3 || z == -4 || z == 1 || z == 2 || z == 3 || z == 4) {
-        info.tileId = 2; // road
-    }
+namespace
+{
+enum class ChunkEncoding : std::uint8_t {
+    Raw = 0,
+    RLE = 1, // (run length - 1, tile id) pairs
+};
+}
 
-    if (z == -6 || z == 6) {
-        info.tileId = 4; // curb
+void TileMap::load(util::FileReader& fr)
+{
+    static_assert(sizeof(Tile) == 1, "chunks are read directly from the file");
+
+    minX = fr.GetInt16();
+    minZ = fr.GetInt16();
+    widthInChunks = fr.GetUInt16();
+    heightInChunks = fr.GetUInt16();
+    widthInTiles = widthInChunks * CHUNK_SIZE;
+    heightInTiles = heightInChunks * CHUNK_SIZE;
+
+    const auto numChunks = fr.GetUInt16();
+
+    chunkIds.resize(widthInChunks * heightInChunks);
+    fr.ReadArr(chunkIds.data(), chunkIds.size());
+    for (const auto chunkId : chunkIds) {
+        psyqo::Kernel::assert(
+            chunkId < numChunks || chunkId == NULL_CHUNK_ID, "Invalid tile map chunk id");
     }
 
-    if (x == -1 || x == -2) {
-        if (info.tileId == 3) {
-            info.tileId = 4; // sidewalk (parallel)
-        } else if (info.tileId == 1 || info.tileId == 2) {
-            info.tileId = 0; // crossing
+    chunks.resize(numChunks);
+    for (auto& chunk : chunks) {
+        const auto encoding = static_cast<ChunkEncoding>(fr.GetUInt8());
+        if (encoding == ChunkEncoding::Raw) {
+            fr.ReadArr(chunk.tiles, CHUNK_SIZE * CHUNK_SIZE);
+            continue;
         }
-    }
-
-    if (z == 5) { // curb transition (near)
-        info.tileId = 5;
-    }
 
-    if (z == -5) { // curb transition (far)
-        info.tileId = 6;
-    }
-
-    if (z < -21) {
-        info.tileId = Tile::NULL_TILE_ID;
+        int i = 0;
+        while (i < CHUNK_SIZE * CHUNK_SIZE) {
+            const int runLength = fr.GetUInt8() + 1;
+            const auto tileId = fr.GetUInt8();
+            psyqo::Kernel::assert(
+                i + runLength <= CHUNK_SIZE * CHUNK_SIZE, "Tile map RLE run overflows its chunk");
+            for (int j = 0; j < runLength; ++j) {
+                chunk.tiles[i + j].tileId = tileId;
+            }
+            i += runLength;
+        }
     }
-
-    return info;
 }
@@ -36,9 +36,40 @@ struct Tile {
     uint8_t tileId{NULL_TILE_ID};
 };
 
+namespace util
+{
+struct FileReader;
+}
+
 struct TileMap {
+    // The map is stored in CHUNK_SIZE x CHUNK_SIZE chunks of tiles.
+    // Identical chunks are shared and chunks which only have null tiles are not stored.
+    static constexpr int CHUNK_SHIFT = 4;
+    static constexpr int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+    static constexpr int CHUNK_MASK = CHUNK_SIZE - 1;
+    static constexpr std::uint16_t NULL_CHUNK_ID = 0xFFFF;
+
+    struct Chunk {
+        Tile tiles[CHUNK_SIZE * CHUNK_SIZE];
+    };
+
+    void load(util::FileReader& fr);
+
     // TODO: return ref
-    Tile getTile(TileIndex ti) const;
+    Tile getTile(TileIndex ti) const
+    {
+        const unsigned x = ti.x - minX;
+        const unsigned z = ti.z - minZ;
+        if (x >= widthInTiles || z >= heightInTiles) {
+            return Tile{};
+        }
+
+        const auto chunkId = chunkIds[(z >> CHUNK_SHIFT) * widthInChunks + (x >> CHUNK_SHIFT)];
+        if (chunkId == NULL_CHUNK_ID) {
+            return Tile{};
+        }
+        return chunks[chunkId].tiles[(z & CHUNK_MASK) * CHUNK_SIZE + (x & CHUNK_MASK)];
+    }
 
     static constexpr TileIndex getTileIndex(const psyqo::Vec3& pos)
     {
@@ -56,4 +87,16 @@ struct TileMap {
     }
 
     Tileset tileset;
+
+    // tile index of the top-left tile of the first chunk
+    int minX{0};
+    int minZ{0};
+
+    unsigned widthInChunks{0};
+    unsigned heightInChunks{0};
+    unsigned widthInTiles{0};
+    unsigned heightInTiles{0};
+
+    eastl::vector<std::uint16_t> chunkIds; // widthInChunks * heightInChunks, row by row
+    eastl::vector<Chunk> chunks;
 };
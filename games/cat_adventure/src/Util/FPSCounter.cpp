@@ -16,3 +16,37 @@ void FPSCounter::update(const psyqo::GPU& gpu)
     // lerp
     avgFPS = avgFPS + lerpFactor * (newFPS - avgFPS);
 }
+
+void FPSCounter::beginDraw(const psyqo::GPU& gpu)
+{
+    drawStartTime = gpu.now();
+    passStartTime = drawStartTime;
+}
+
+void FPSCounter::endPass(const psyqo::GPU& gpu, DrawPass pass)
+{
+    const auto t = gpu.now();
+    passTimes[(std::size_t)pass] = t - passStartTime;
+    passStartTime = t;
+}
+
+void FPSCounter::endDraw(const psyqo::GPU& gpu)
+{
+    drawTime = gpu.now() - drawStartTime;
+
+    gpuBound = gpu.isChainTransferring();
+    if (gpuBound) {
+        ++numGPUBoundFrames;
+    }
+}
+
+void FPSCounter::farPassChained(const psyqo::GPU& gpu, bool chainWasIdle)
+{
+    if (!chainWasIdle) {
+        ++numFarPassesBusy;
+    } else if (gpu.isChainIdle()) {
+        ++numFarPassesDeferred;
+    } else {
+        ++numFarPassesStarted;
+    }
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
+
+#include <EASTL/array.h>
+
 #include <psyqo/fixed-point.hh>
 
 namespace psyqo
@@ -10,6 +14,41 @@ struct GPU;
 struct FPSCounter {
     void update(const psyqo::GPU& gpu);
 
+    // Parts of GameplayScene::draw which are timed separately
+    enum class DrawPass {
+        Tiles,
+        StaticObjects,
+        DynamicObjects,
+        Overlays, // fade, UI, debug info
+        Count,
+    };
+
+    // Frame time counters: call beginDraw before building the frame's chain, endPass after
+    // each pass and endDraw when everything is chained.
+    void beginDraw(const psyqo::GPU& gpu);
+    void endPass(const psyqo::GPU& gpu, DrawPass pass);
+    void endDraw(const psyqo::GPU& gpu);
+
+    // CPU time (in microseconds) spent building the last frame's chain and each of its passes
+    std::uint32_t drawTime{0};
+    eastl::array<std::uint32_t, (std::size_t)DrawPass::Count> passTimes{};
+    std::uint32_t drawStartTime{0};
+    std::uint32_t passStartTime{0};
+
+    // If the previous frame's chain was still being transferred when the current one was done,
+    // the frame is GPU bound.
+    bool gpuBound{false};
+    int numGPUBoundFrames{0};
+
+    // Early submission (Renderer::earlySubmit): call after Renderer::chainFarPass.
+    // chainWasIdle - GPU::isChainIdle() right before the far pass was chained
+    void farPassChained(const psyqo::GPU& gpu, bool chainWasIdle);
+
+    // what happened to the far pass after it was chained
+    int numFarPassesStarted{0}; // the transfer started right away
+    int numFarPassesDeferred{0}; // the chain was idle, but the transfer didn't start
+    int numFarPassesBusy{0}; // the previous frame's chain was still being transferred
+
     const psyqo::FixedPoint<> getMovingAverage() const { return fpsMovingAverageNew; }
     const psyqo::FixedPoint<> getAverage() const { return avgFPS; }
 
@@ -1,14 +1,148 @@
 #include "AnimationWriter.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <fstream>
 
 #include <FsUtil.h>
+#include <glm/geometric.hpp>
 
 #include "ConversionParams.h"
 #include "FixedPoint.h"
 #include "ModelJsonFile.h"
 
-#include "DJBHash.h"
+#include <DJBHash.h>
+
+namespace
+{
+// "ANMC" - see loadAnimations in the game for the format description
+constexpr std::uint32_t COMPRESSED_ANIM_MAGIC = 0x434D4E41;
+
+// 4.12 component = (s * QUAT_COMPONENT_SCALE) >> 10, maps +-511 to +-1/sqrt(2)
+constexpr float QUAT_COMPONENT_SCALE = 5799.f;
+constexpr int PACKED_COMPONENT_MAX = 511;
+
+std::uint32_t packComponent(int v, int shift)
+{
+    v = std::clamp(v, -PACKED_COMPONENT_MAX, PACKED_COMPONENT_MAX);
+    return (static_cast<std::uint32_t>(v) & 0x3FF) << shift;
+}
+
+// "smallest three": index of the largest component (in w, x, y, z order) in the top two bits,
+// the other three are stored as signed 10-bit values. The largest one is always positive.
+std::uint32_t packRotation(const glm::quat& q)
+{
+    const float c[4] = {q.w, q.x, q.y, q.z};
+    int largest = 0;
+    for (int i = 1; i < 4; ++i) {
+        if (std::abs(c[i]) > std::abs(c[largest])) {
+            largest = i;
+        }
+    }
+    const float sign = (c[largest] < 0.f) ? -1.f : 1.f;
+
+    std::uint32_t packed = static_cast<std::uint32_t>(largest) << 30;
+    int shift = 20;
+    for (int i = 0; i < 4; ++i) {
+        if (i == largest) {
+            continue;
+        }
+        const auto v = std::lround(sign * c[i] * 4096.f * 1024.f / QUAT_COMPONENT_SCALE);
+        packed |= packComponent(static_cast<int>(v), shift);
+        shift -= 10;
+    }
+    return packed;
+}
+
+// Same as the game does it (nlerp): second key is flipped to the first one's hemisphere
+glm::quat lerpRotation(const glm::quat& a, glm::quat b, float t)
+{
+    if (glm::dot(a, b) < 0.f) {
+        b = -b;
+    }
+    return glm::normalize(a * (1.f - t) + b * t);
+}
+
+bool isClose(const AnimationKey& a,
+    const AnimationKey& b,
+    std::uint8_t trackType,
+    const ConversionParams& params)
+{
+    if (trackType == 0) {
+        // q and -q are the same rotation
+        const auto& q = a.data.rotation;
+        const auto expected =
+            glm::dot(q, b.data.rotation) < 0.f ? -b.data.rotation : b.data.rotation;
+        for (int i = 0; i < 4; ++i) {
+            if (std::abs(q[i] - expected[i]) > params.animRotationTolerance) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return glm::length(a.data.translation - b.data.translation) <=
+           params.animTranslationTolerance;
+}
+
+// Whether interpolating between a and b gives key's value within tolerance
+bool isKeyReproduced(const AnimationKey& a,
+    const AnimationKey& b,
+    const AnimationKey& key,
+    std::uint8_t trackType,
+    const ConversionParams& params)
+{
+    const float t = static_cast<float>(key.frame - a.frame) / static_cast<float>(b.frame - a.frame);
+    AnimationKey interpolated{.frame = key.frame};
+    if (trackType == 0) {
+        interpolated.data.rotation = lerpRotation(a.data.rotation, b.data.rotation, t);
+    } else {
+        interpolated.data.translation =
+            a.data.translation * (1.f - t) + b.data.translation * t;
+    }
+    return isClose(interpolated, key, trackType, params);
+}
+
+bool isSegmentReproduced(const std::vector<AnimationKey>& keys,
+    std::size_t from,
+    std::size_t to,
+    std::uint8_t trackType,
+    const ConversionParams& params)
+{
+    for (std::size_t i = from + 1; i < to; ++i) {
+        if (!isKeyReproduced(keys[from], keys[to], keys[i], trackType, params)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Removes keys which interpolating between the remaining ones reproduces within tolerance.
+// Tracks where all keys are the same are reduced to one key (constant tracks).
+std::vector<AnimationKey> reduceKeys(const AnimationTrack& track, const ConversionParams& params)
+{
+    const auto& keys = track.keys;
+    const bool isConstant = std::all_of(keys.begin(), keys.end(), [&](const AnimationKey& key) {
+        return isClose(keys.front(), key, track.trackType, params);
+    });
+    if (isConstant || keys.size() <= 2) {
+        return {keys.begin(), keys.begin() + (isConstant ? 1 : keys.size())};
+    }
+
+    std::vector<AnimationKey> res;
+    res.push_back(keys.front());
+    std::size_t lastKept = 0;
+    for (std::size_t i = 1; i + 1 < keys.size(); ++i) {
+        if (!isSegmentReproduced(keys, lastKept, i + 1, track.trackType, params)) {
+            res.push_back(keys[i]);
+            lastKept = i;
+        }
+    }
+    res.push_back(keys.back());
+    return res;
+}
+
+} // end of anonymous namespace
 
 void writeAnimationsToFile(
     std::filesystem::path& path,
@@ -16,6 +150,7 @@ void writeAnimationsToFile(
     const ConversionParams& params)
 {
     std::ofstream file(path, std::ios::binary);
+    fsutil::binaryWrite(file, COMPRESSED_ANIM_MAGIC);
     fsutil::binaryWrite(file, static_cast<std::uint32_t>(animations.size()));
     for (const auto& anim : animations) {
         fsutil::binaryWrite(file, DJBHash::hash(anim.name));
@@ -28,25 +163,67 @@ void writeAnimationsToFile(
         fsutil::binaryWrite(file, static_cast<std::uint16_t>(anim.tracks.size()));
 
         for (const auto& track : anim.tracks) {
+            const auto keys = reduceKeys(track, params);
+
+            std::vector<std::uint32_t> values;
+            values.reserve(keys.size());
+
+            // translations are stored as deltas from the first key, shifted until all of them
+            // fit into 10 bits
+            std::array<std::int16_t, 3> base{};
+            std::uint8_t shift = 0;
+            if (track.trackType == 0) {
+                for (const auto& key : keys) {
+                    values.push_back(packRotation(key.data.rotation));
+                }
+            } else if (track.trackType == 1) {
+                std::vector<std::array<std::int16_t, 3>> translations;
+                for (const auto& key : keys) {
+                    const auto& tr = key.data.translation;
+                    translations.push_back({
+                        floatToFixed<std::int16_t>(tr.x, params.scale),
+                        floatToFixed<std::int16_t>(tr.y, params.scale),
+                        floatToFixed<std::int16_t>(tr.z, params.scale),
+                    });
+                }
+
+                base = translations[0];
+                int maxDelta = 0;
+                for (const auto& tr : translations) {
+                    for (int i = 0; i < 3; ++i) {
+                        maxDelta = std::max(maxDelta, std::abs(tr[i] - base[i]));
+                    }
+                }
+                while ((maxDelta >> shift) > PACKED_COMPONENT_MAX) {
+                    ++shift;
+                }
+
+                for (const auto& tr : translations) {
+                    values.push_back(packComponent((tr[0] - base[0]) >> shift, 20) |
+                                     packComponent((tr[1] - base[1]) >> shift, 10) |
+                                     packComponent((tr[2] - base[2]) >> shift, 0));
+                }
+            } else { // not supported by the game, but keep the layout the same
+                values.resize(keys.size(), 0);
+            }
+
             fsutil::binaryWrite(file, static_cast<std::uint8_t>(track.trackType));
             fsutil::binaryWrite(file, static_cast<std::uint8_t>(track.jointId));
-            fsutil::binaryWrite(file, static_cast<std::uint16_t>(track.keys.size()));
-            for (const auto& key : track.keys) {
-                fsutil::binaryWrite(file, floatToFixed<std::int32_t>((float)key.frame));
-                if (track.trackType == 0) {
-                    fsutil::binaryWrite(file, floatToFixed<std::int16_t>(key.data.rotation.w));
-                    fsutil::binaryWrite(file, floatToFixed<std::int16_t>(key.data.rotation.x));
-                    fsutil::binaryWrite(file, floatToFixed<std::int16_t>(key.data.rotation.y));
-                    fsutil::binaryWrite(file, floatToFixed<std::int16_t>(key.data.rotation.z));
-                } else if (track.trackType == 1) {
-                    fsutil::binaryWrite(
-                        file, floatToFixed<std::int16_t>(key.data.translation.x, params.scale));
-                    fsutil::binaryWrite(
-                        file, floatToFixed<std::int16_t>(key.data.translation.y, params.scale));
-                    fsutil::binaryWrite(
-                        file, floatToFixed<std::int16_t>(key.data.translation.z, params.scale));
-                    fsutil::binaryWrite(file, std::uint16_t{}); // pad
-                }
+            fsutil::binaryWrite(file, static_cast<std::uint16_t>(keys.size()));
+            fsutil::binaryWrite(file, shift);
+            fsutil::binaryWrite(file, std::uint8_t{}); // pad
+            for (const auto b : base) {
+                fsutil::binaryWrite(file, b);
+            }
+
+            for (const auto& key : keys) {
+                fsutil::binaryWrite(file, static_cast<std::uint16_t>(key.frame));
+            }
+            if (keys.size() % 2 != 0) {
+                fsutil::binaryWrite(file, std::uint16_t{}); // pad
+            }
+            for (const auto v : values) {
+                fsutil::binaryWrite(file, v);
             }
         }
     }
@@ -1,6 +1,18 @@
 #pragma once
 
+#include <array>
+
 struct ConversionParams {
     float scale{1.f};
     bool isLevel{false};
+
+    // number of LODs generated for submeshes which don't have hand-made ones
+    int numLods{2};
+    // distances (in model units) from which each LOD is used
+    std::array<float, 2> lodDistances{8.f, 16.f};
+
+    // animation keys which interpolating their neighbours reproduces within these
+    // tolerances are removed
+    float animRotationTolerance{0.002f}; // max error of each quaternion component
+    float animTranslationTolerance{0.004f}; // in model units (before scaling)
 };
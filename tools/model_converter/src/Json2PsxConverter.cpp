@@ -1,14 +1,18 @@
 #include "Json2PsxConverter.h"
 
+#include "MeshDecimation.h"
 #include "ModelJsonFile.h"
 #include "PsxModel.h"
 #include "TexturesData.h"
 
 #include <FixedPoint.h>
 
+#include <algorithm>
+#include <cctype>
 #include <format>
 #include <iostream>
 #include <stack>
+#include <string>
 
 namespace
 {
@@ -242,6 +246,109 @@ PsxSubmesh processMesh(
     return psxMesh;
 }
 
+// Hand-made LODs are meshes named "<name>_lod1", "<name>_lod2" etc.
+// Returns the LOD level (0 for usual meshes) and the name of the mesh the LOD is made for
+int getLodLevel(const std::string& meshName, std::string& baseName)
+{
+    static const std::string suffix = "_lod";
+
+    baseName = meshName;
+    const auto pos = meshName.rfind(suffix);
+    if (pos == std::string::npos) {
+        return 0;
+    }
+
+    const auto levelStr = meshName.substr(pos + suffix.size());
+    if (levelStr.empty() || !std::all_of(levelStr.begin(), levelStr.end(), [](char c) {
+            return std::isdigit(static_cast<unsigned char>(c));
+        })) {
+        return 0;
+    }
+
+    baseName = meshName.substr(0, pos);
+    return std::stoi(levelStr);
+}
+
+struct HandMadeLod {
+    std::string baseName;
+    int level;
+    PsxSubmesh mesh;
+    bool used{false};
+};
+
+// Each collapse step halves the number of faces until it's not worth it anymore
+void generateLods(PsxSubmesh& submesh, const ConversionParams& params)
+{
+    static constexpr std::size_t MIN_DECIMATED_FACES = 16;
+
+    const auto numLods = std::min(static_cast<std::size_t>(params.numLods), MAX_SUBMESH_LODS);
+    submesh.lods.reserve(numLods);
+    for (std::size_t i = 0; i < numLods; ++i) {
+        const auto& prev = submesh.lods.empty() ? submesh : submesh.lods.back();
+        const auto numFaces = getNumFaces(prev);
+        if (numFaces < MIN_DECIMATED_FACES) {
+            break;
+        }
+
+        auto lod = decimateMesh(prev, numFaces / 2);
+        if (getNumFaces(lod) * 4 > numFaces * 3) { // less than 25% of faces removed
+            break;
+        }
+        submesh.lods.push_back(std::move(lod));
+    }
+}
+
+void addLods(std::vector<PsxSubmesh>& submeshes,
+    const std::vector<std::string>& submeshNames,
+    std::vector<HandMadeLod>& handMadeLods,
+    const ConversionParams& params)
+{
+    for (std::size_t i = 0; i < submeshes.size(); ++i) {
+        auto& submesh = submeshes[i];
+
+        // skinned meshes are split by joints, so LODs are matched by the joint too
+        std::vector<HandMadeLod*> lods;
+        for (auto& lod : handMadeLods) {
+            if (lod.baseName == submeshNames[i] && lod.mesh.jointId == submesh.jointId) {
+                lods.push_back(&lod);
+            }
+        }
+        std::sort(lods.begin(), lods.end(), [](const HandMadeLod* a, const HandMadeLod* b) {
+            return a->level < b->level;
+        });
+
+        if (lods.size() > MAX_SUBMESH_LODS) {
+            throw std::runtime_error(std::format("submesh {} has {} LODs (max is {})",
+                submeshNames[i],
+                lods.size(),
+                MAX_SUBMESH_LODS));
+        }
+
+        if (!lods.empty()) {
+            for (auto* lod : lods) {
+                submesh.lods.push_back(lod->mesh);
+                lod->used = true;
+            }
+        } else {
+            generateLods(submesh, params);
+        }
+
+        for (std::size_t j = 0; j < submesh.lods.size(); ++j) {
+            submesh.lods[j].lodDistance =
+                floatToFixed<FixedPoint4_12>(params.lodDistances[j], params.scale);
+        }
+    }
+
+    for (const auto& lod : handMadeLods) {
+        if (!lod.used) {
+            throw std::runtime_error(std::format("no mesh found for LOD {}_lod{} (joint {})",
+                lod.baseName,
+                lod.level,
+                lod.mesh.jointId));
+        }
+    }
+}
+
 } // end of anonymous namespace
 
 PsxModel jsonToPsxModel(
@@ -251,14 +358,31 @@ PsxModel jsonToPsxModel(
 {
     PsxModel psxModel;
 
+    std::vector<std::string> submeshNames;
+    std::vector<HandMadeLod> handMadeLods;
+    const auto addSubmesh = [&](const Mesh& mesh, const glm::mat4& tm) {
+        auto psxMesh = processMesh(modelJson, textures, params, tm, mesh);
+        std::string baseName;
+        const auto level = getLodLevel(mesh.name, baseName);
+        if (level > 0) {
+            handMadeLods.push_back(HandMadeLod{
+                .baseName = std::move(baseName),
+                .level = level,
+                .mesh = std::move(psxMesh),
+            });
+        } else {
+            submeshNames.push_back(mesh.name);
+            psxModel.submeshes.push_back(std::move(psxMesh));
+        }
+    };
+
     if (!params.isLevel) {
         for (const auto& object : modelJson.objects) {
             if (object.mesh == -1) {
                 continue;
             }
             const auto& mesh = modelJson.meshes[object.mesh];
-            psxModel.submeshes.push_back(
-                processMesh(modelJson, textures, params, object.transform.asMatrix(), mesh));
+            addSubmesh(mesh, object.transform.asMatrix());
         }
     } else {
         static const glm::mat4 I{1.0};
@@ -274,8 +398,7 @@ PsxModel jsonToPsxModel(
         assert(modelJson.objects.size() == 1);
         const auto& object = modelJson.objects[0];
         for (const auto& mesh : modelJson.meshes) {
-            psxModel.submeshes.push_back(
-                processMesh(modelJson, textures, params, object.transform.asMatrix(), mesh));
+            addSubmesh(mesh, object.transform.asMatrix());
         }
 
         // convert joints
@@ -318,11 +441,18 @@ PsxModel jsonToPsxModel(
             for (int i = 0; i < joint.children.size(); ++i) {
                 const auto childId = joint.children[i];
                 auto& child = armature.joints[childId];
+                child.parent = id;
                 child.nextSibling = (i == joint.children.size() - 1) ? PsxJoint::NULL_JOINT_ID :
                                                                        joint.children[i + 1];
                 jointsToProcess.push(childId);
             }
         }
     }
+
+    // levels are drawn tile by tile, LODs are only used for models
+    if (!params.isLevel) {
+        addLods(psxModel.submeshes, submeshNames, handMadeLods, params);
+    }
+
     return psxModel;
 }
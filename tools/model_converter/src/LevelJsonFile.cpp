@@ -1,5 +1,6 @@
 #include "LevelJsonFile.h"
 
+#include <algorithm>
 #include <format>
 #include <fstream>
 
@@ -15,6 +16,60 @@ std::uint8_t getUInt8(const nlohmann::json& obj, const char* key)
     }
     return v;
 }
+
+int getInt(const nlohmann::json& obj, const char* key, int defaultValue)
+{
+    if (!obj.contains(key)) {
+        return defaultValue;
+    }
+    return obj.at(key).get<int>();
+}
+
+/* The tile map is described as a default tile and a list of rects which are filled in order, e.g.
+ * "tilemap": {
+ *   "min_x": -64, "min_z": -21, "width": 128, "height": 64,
+ *   "default_tile": 3,
+ *   "fill": [ { "tile": 2, "min_z": -4, "max_z": 4 }, ... ]
+ * }
+ * Rect bounds are inclusive. Missing bounds are the bounds of the map.
+ */
+TileMapJson parseTileMap(const nlohmann::json& tileMapObj)
+{
+    TileMapJson tileMap;
+    tileMap.minX = tileMapObj.at("min_x").get<int>();
+    tileMap.minZ = tileMapObj.at("min_z").get<int>();
+    tileMap.width = tileMapObj.at("width").get<int>();
+    tileMap.height = tileMapObj.at("height").get<int>();
+    if (tileMap.width <= 0 || tileMap.height <= 0) {
+        throw std::runtime_error("bad tile map size");
+    }
+
+    const auto defaultTile = tileMapObj.contains("default_tile") ?
+                                 getUInt8(tileMapObj, "default_tile") :
+                                 TileMapJson::NULL_TILE_ID;
+    tileMap.tiles.resize(tileMap.width * tileMap.height, defaultTile);
+
+    if (!tileMapObj.contains("fill")) {
+        return tileMap;
+    }
+
+    const auto maxX = tileMap.minX + tileMap.width - 1;
+    const auto maxZ = tileMap.minZ + tileMap.height - 1;
+    for (const auto& rectObj : tileMapObj.at("fill")) {
+        const auto tileId = getUInt8(rectObj, "tile");
+        const auto x0 = std::max(getInt(rectObj, "min_x", tileMap.minX), tileMap.minX);
+        const auto x1 = std::min(getInt(rectObj, "max_x", maxX), maxX);
+        const auto z0 = std::max(getInt(rectObj, "min_z", tileMap.minZ), tileMap.minZ);
+        const auto z1 = std::min(getInt(rectObj, "max_z", maxZ), maxZ);
+        for (int z = z0; z <= z1; ++z) {
+            for (int x = x0; x <= x1; ++x) {
+                tileMap.tiles[(z - tileMap.minZ) * tileMap.width + (x - tileMap.minX)] = tileId;
+            }
+        }
+    }
+
+    return tileMap;
+}
 }
 
 LevelJson parseLevelJsonFile(
@@ -64,5 +119,9 @@ LevelJson parseLevelJsonFile(
         }
     }
 
+    if (root.contains("tilemap")) {
+        level.tileMap = parseTileMap(root.at("tilemap"));
+    }
+
     return level;
 }
@@ -18,10 +18,26 @@ struct TileInfo {
     float height{0.f};
 };
 
+struct TileMapJson {
+    static constexpr std::uint8_t NULL_TILE_ID = 0xFF;
+
+    // tile index of the top-left tile
+    int minX{0};
+    int minZ{0};
+
+    int width{0};
+    int height{0};
+
+    std::vector<std::uint8_t> tiles; // width * height tile ids, row by row
+
+    std::uint8_t getTile(int x, int z) const { return tiles[(z - minZ) * width + (x - minX)]; }
+};
+
 struct LevelJson {
     std::vector<std::string> usedTextures;
     std::vector<std::string> usedModels;
     std::vector<TileInfo> tileset;
+    TileMapJson tileMap;
 };
 
 LevelJson parseLevelJsonFile(
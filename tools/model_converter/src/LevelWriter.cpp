@@ -1,7 +1,10 @@
 #include "LevelWriter.h"
 
 #include <FsUtil.h>
+#include <algorithm>
+#include <array>
 #include <fstream>
+#include <stdexcept>
 
 #include "ConversionParams.h"
 #include "FixedPoint.h"
@@ -9,11 +12,111 @@
 #include "ModelJsonFile.h"
 #include "PsxModel.h"
 
-#include "DJBHash.h"
+#include <DJBHash.h>
 
 static const std::uint8_t pad8{0};
 static const std::uint16_t pad16{0};
 
+namespace
+{
+// Should be the same as TileMap::CHUNK_SIZE in the game
+constexpr int TILE_CHUNK_SIZE = 16;
+constexpr std::uint16_t NULL_CHUNK_ID = 0xFFFF;
+
+enum class TileChunkEncoding : std::uint8_t {
+    Raw = 0,
+    RLE = 1,
+};
+
+using TileChunk = std::array<std::uint8_t, TILE_CHUNK_SIZE * TILE_CHUNK_SIZE>;
+
+// Encoded as (run length - 1, tile id) pairs
+std::vector<std::uint8_t> encodeRLE(const TileChunk& chunk)
+{
+    std::vector<std::uint8_t> res;
+    for (std::size_t i = 0; i < chunk.size();) {
+        std::size_t runLength = 1;
+        while (i + runLength < chunk.size() && runLength < 256 &&
+               chunk[i + runLength] == chunk[i]) {
+            ++runLength;
+        }
+        res.push_back(static_cast<std::uint8_t>(runLength - 1));
+        res.push_back(chunk[i]);
+        i += runLength;
+    }
+    return res;
+}
+
+/* The tile map is split into TILE_CHUNK_SIZE x TILE_CHUNK_SIZE chunks.
+ * Identical chunks are only stored once and chunks which only have null tiles
+ * are not stored at all.
+ */
+void writeTileMap(std::ostream& file, const TileMapJson& tileMap)
+{
+    const auto widthInChunks = (tileMap.width + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+    const auto heightInChunks = (tileMap.height + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+
+    std::vector<TileChunk> chunks;
+    std::vector<std::uint16_t> chunkIds;
+    chunkIds.reserve(widthInChunks * heightInChunks);
+    for (int cz = 0; cz < heightInChunks; ++cz) {
+        for (int cx = 0; cx < widthInChunks; ++cx) {
+            TileChunk chunk;
+            chunk.fill(TileMapJson::NULL_TILE_ID);
+            bool isEmpty = true;
+            for (int z = 0; z < TILE_CHUNK_SIZE; ++z) {
+                for (int x = 0; x < TILE_CHUNK_SIZE; ++x) {
+                    const auto tx = cx * TILE_CHUNK_SIZE + x;
+                    const auto tz = cz * TILE_CHUNK_SIZE + z;
+                    if (tx >= tileMap.width || tz >= tileMap.height) {
+                        continue;
+                    }
+                    const auto tileId = tileMap.tiles[tz * tileMap.width + tx];
+                    chunk[z * TILE_CHUNK_SIZE + x] = tileId;
+                    isEmpty = isEmpty && (tileId == TileMapJson::NULL_TILE_ID);
+                }
+            }
+
+            if (isEmpty) {
+                chunkIds.push_back(NULL_CHUNK_ID);
+                continue;
+            }
+
+            auto it = std::find(chunks.begin(), chunks.end(), chunk);
+            if (it == chunks.end()) {
+                chunks.push_back(chunk);
+                it = chunks.end() - 1;
+            }
+            chunkIds.push_back(static_cast<std::uint16_t>(it - chunks.begin()));
+        }
+    }
+
+    if (chunks.size() >= NULL_CHUNK_ID) {
+        throw std::runtime_error("too many tile chunks");
+    }
+
+    fsutil::binaryWrite(file, static_cast<std::int16_t>(tileMap.minX));
+    fsutil::binaryWrite(file, static_cast<std::int16_t>(tileMap.minZ));
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(widthInChunks));
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(heightInChunks));
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(chunks.size()));
+    for (const auto chunkId : chunkIds) {
+        fsutil::binaryWrite(file, chunkId);
+    }
+
+    for (const auto& chunk : chunks) {
+        const auto rle = encodeRLE(chunk);
+        if (rle.size() < chunk.size()) {
+            fsutil::binaryWrite(file, TileChunkEncoding::RLE);
+            file.write(reinterpret_cast<const char*>(rle.data()), rle.size());
+        } else {
+            fsutil::binaryWrite(file, TileChunkEncoding::Raw);
+            file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+        }
+    }
+}
+}
+
 void writeLevelToFile(
     std::filesystem::path& path,
     const ModelJson& model,
@@ -143,4 +246,6 @@ void writeLevelToFileNew(
         fsutil::binaryWrite(
             file, floatToFixed<std::int16_t>(trigger.aabb.max.z, conversionParams.scale));
     }
+
+    writeTileMap(file, level.tileMap);
 }
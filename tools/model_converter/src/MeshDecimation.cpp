@@ -0,0 +1,316 @@
+#include "MeshDecimation.h"
+
+#include "PsxModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+namespace
+{
+
+struct DecimatedFace {
+    // vertex ids and vertices in perimeter order
+    std::vector<int> ids;
+    std::vector<PsxVert> vs;
+    bool textured{false};
+    bool semiTrans{false};
+    std::int16_t bias{0};
+    bool removed{false};
+};
+
+struct DecimatedMesh {
+    std::vector<glm::dvec3> positions;
+    std::vector<DecimatedFace> faces;
+    // indices of faces which use the vertex (can contain removed faces)
+    std::vector<std::vector<int>> vertexFaces;
+    std::size_t numFaces{0};
+};
+
+using Edge = std::pair<int, int>;
+
+Edge makeEdge(int a, int b)
+{
+    return a < b ? Edge{a, b} : Edge{b, a};
+}
+
+void addFace(DecimatedMesh& dm,
+    std::map<std::tuple<FixedPoint4_12, FixedPoint4_12, FixedPoint4_12>, int>& vertexIds,
+    std::vector<PsxVert> vs,
+    bool textured,
+    bool semiTrans,
+    std::int16_t bias)
+{
+    DecimatedFace face{
+        .vs = std::move(vs),
+        .textured = textured,
+        .semiTrans = semiTrans,
+        .bias = bias,
+    };
+
+    const auto faceIdx = static_cast<int>(dm.faces.size());
+    for (const auto& v : face.vs) {
+        const auto key = std::tuple{v.pos.x, v.pos.y, v.pos.z};
+        auto it = vertexIds.find(key);
+        if (it == vertexIds.end()) {
+            it = vertexIds.emplace(key, static_cast<int>(dm.positions.size())).first;
+            dm.positions.push_back(glm::dvec3(v.pos.x, v.pos.y, v.pos.z));
+            dm.vertexFaces.emplace_back();
+        }
+        face.ids.push_back(it->second);
+        dm.vertexFaces[it->second].push_back(faceIdx);
+    }
+
+    dm.faces.push_back(std::move(face));
+    ++dm.numFaces;
+}
+
+DecimatedMesh buildDecimatedMesh(const PsxSubmesh& mesh)
+{
+    DecimatedMesh dm;
+    std::map<std::tuple<FixedPoint4_12, FixedPoint4_12, FixedPoint4_12>, int> vertexIds;
+
+    const auto addTris = [&](const std::vector<PsxTriFace>& faces, bool textured) {
+        for (const auto& f : faces) {
+            addFace(dm, vertexIds, {f.vs[0], f.vs[1], f.vs[2]}, textured, f.semiTrans, f.bias);
+        }
+    };
+    // PS1 quads are stored in "Z" order, so the perimeter is 0, 1, 3, 2
+    const auto addQuads = [&](const std::vector<PsxQuadFace>& faces, bool textured) {
+        for (const auto& f : faces) {
+            addFace(dm,
+                vertexIds,
+                {f.vs[0], f.vs[1], f.vs[3], f.vs[2]},
+                textured,
+                f.semiTrans,
+                f.bias);
+        }
+    };
+
+    addTris(mesh.untexturedTriFaces, false);
+    addQuads(mesh.untexturedQuadFaces, false);
+    addTris(mesh.triFaces, true);
+    addQuads(mesh.quadFaces, true);
+
+    return dm;
+}
+
+// Newell's method - works for both triangles and (possibly non-planar) quads
+glm::dvec3 calculateNormal(const DecimatedMesh& dm, const std::vector<int>& ids)
+{
+    glm::dvec3 n{};
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        const auto& a = dm.positions[ids[i]];
+        const auto& b = dm.positions[ids[(i + 1) % ids.size()]];
+        n.x += (a.y - b.y) * (a.z + b.z);
+        n.y += (a.z - b.z) * (a.x + b.x);
+        n.z += (a.x - b.x) * (a.y + b.y);
+    }
+    return n;
+}
+
+// Removes repeated corners. Returns false if the face became degenerate.
+bool removeCollapsedCorners(std::vector<int>& ids, std::vector<PsxVert>* vs)
+{
+    for (std::size_t i = 0; i < ids.size() && ids.size() > 1;) {
+        if (ids[i] == ids[(i + 1) % ids.size()]) {
+            ids.erase(ids.begin() + i);
+            if (vs) {
+                vs->erase(vs->begin() + i);
+            }
+        } else {
+            ++i;
+        }
+    }
+
+    if (ids.size() < 3) {
+        return false;
+    }
+    // e.g. quad "a, b, a, c" - two slivers, nothing worth keeping
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        for (std::size_t j = i + 1; j < ids.size(); ++j) {
+            if (ids[i] == ids[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::map<Edge, int> countEdgeUses(const DecimatedMesh& dm)
+{
+    std::map<Edge, int> edgeUses;
+    for (const auto& face : dm.faces) {
+        if (face.removed) {
+            continue;
+        }
+        for (std::size_t i = 0; i < face.ids.size(); ++i) {
+            ++edgeUses[makeEdge(face.ids[i], face.ids[(i + 1) % face.ids.size()])];
+        }
+    }
+    return edgeUses;
+}
+
+// Checks that no face which survives the collapse of b into a gets flipped
+bool canCollapse(DecimatedMesh& dm, int a, int b, const glm::dvec3& newPos)
+{
+    const auto checkFaces = [&](int v) {
+        for (const auto faceIdx : dm.vertexFaces[v]) {
+            const auto& face = dm.faces[faceIdx];
+            if (face.removed) {
+                continue;
+            }
+
+            const auto oldNormal = calculateNormal(dm, face.ids);
+
+            auto ids = face.ids;
+            std::replace(ids.begin(), ids.end(), b, a);
+            if (!removeCollapsedCorners(ids, nullptr)) {
+                continue; // will be removed
+            }
+
+            const auto oldA = dm.positions[a];
+            dm.positions[a] = newPos;
+            const auto newNormal = calculateNormal(dm, ids);
+            dm.positions[a] = oldA;
+
+            if (glm::dot(oldNormal, newNormal) <= 0.0) {
+                return false;
+            }
+        }
+        return true;
+    };
+    return checkFaces(a) && checkFaces(b);
+}
+
+void collapse(DecimatedMesh& dm, int a, int b, const glm::dvec3& newPos)
+{
+    dm.positions[a] = newPos;
+    for (const auto faceIdx : dm.vertexFaces[b]) {
+        auto& face = dm.faces[faceIdx];
+        if (face.removed) {
+            continue;
+        }
+        std::replace(face.ids.begin(), face.ids.end(), b, a);
+        dm.vertexFaces[a].push_back(faceIdx);
+    }
+    dm.vertexFaces[b].clear();
+
+    for (const auto faceIdx : dm.vertexFaces[a]) {
+        auto& face = dm.faces[faceIdx];
+        if (!face.removed && !removeCollapsedCorners(face.ids, &face.vs)) {
+            face.removed = true;
+            --dm.numFaces;
+        }
+    }
+}
+
+// Collapses the shortest edge which can be collapsed. Returns false if there's none.
+bool collapseShortestEdge(DecimatedMesh& dm)
+{
+    const auto edgeUses = countEdgeUses(dm);
+
+    // vertices on the mesh boundary stay where they are, otherwise the silhouette shrinks
+    std::vector<bool> onBoundary(dm.positions.size(), false);
+    for (const auto& [edge, uses] : edgeUses) {
+        if (uses == 1) {
+            onBoundary[edge.first] = true;
+            onBoundary[edge.second] = true;
+        }
+    }
+
+    std::vector<std::pair<double, Edge>> edges;
+    edges.reserve(edgeUses.size());
+    for (const auto& [edge, uses] : edgeUses) {
+        const auto len = glm::length(dm.positions[edge.first] - dm.positions[edge.second]);
+        edges.push_back({len, edge});
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (const auto& [len, edge] : edges) {
+        auto [a, b] = edge;
+        const bool aOnBoundary = onBoundary[a];
+        const bool bOnBoundary = onBoundary[b];
+
+        glm::dvec3 newPos = (dm.positions[a] + dm.positions[b]) * 0.5;
+        if (aOnBoundary && bOnBoundary) {
+            if (edgeUses.at(edge) != 1) {
+                continue; // would join two parts of the boundary
+            }
+        } else if (aOnBoundary) {
+            newPos = dm.positions[a];
+        } else if (bOnBoundary) {
+            newPos = dm.positions[b];
+            std::swap(a, b);
+        }
+
+        if (canCollapse(dm, a, b, newPos)) {
+            collapse(dm, a, b, newPos);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+FixedPoint4_12 toFixed(double v)
+{
+    return static_cast<FixedPoint4_12>(std::round(v));
+}
+
+} // end of anonymous namespace
+
+std::size_t getNumFaces(const PsxSubmesh& mesh)
+{
+    return mesh.untexturedTriFaces.size() + mesh.untexturedQuadFaces.size() +
+           mesh.triFaces.size() + mesh.quadFaces.size();
+}
+
+PsxSubmesh decimateMesh(const PsxSubmesh& mesh, std::size_t targetNumFaces)
+{
+    auto dm = buildDecimatedMesh(mesh);
+    while (dm.numFaces > targetNumFaces) {
+        if (!collapseShortestEdge(dm)) {
+            break;
+        }
+    }
+
+    PsxSubmesh res{
+        .subdivide = mesh.subdivide,
+        .jointId = mesh.jointId,
+    };
+    for (auto& face : dm.faces) {
+        if (face.removed) {
+            continue;
+        }
+
+        for (std::size_t i = 0; i < face.ids.size(); ++i) {
+            const auto& pos = dm.positions[face.ids[i]];
+            face.vs[i].pos = {toFixed(pos.x), toFixed(pos.y), toFixed(pos.z)};
+        }
+
+        if (face.vs.size() == 3) {
+            auto tri = PsxTriFace{
+                .vs = {face.vs[0], face.vs[1], face.vs[2]},
+                .semiTrans = face.semiTrans,
+                .bias = face.bias,
+            };
+            (face.textured ? res.triFaces : res.untexturedTriFaces).push_back(std::move(tri));
+        } else {
+            // back from perimeter to "Z" order
+            auto quad = PsxQuadFace{
+                .vs = {face.vs[0], face.vs[1], face.vs[3], face.vs[2]},
+                .semiTrans = face.semiTrans,
+                .bias = face.bias,
+            };
+            (face.textured ? res.quadFaces : res.untexturedQuadFaces).push_back(std::move(quad));
+        }
+    }
+
+    return res;
+}
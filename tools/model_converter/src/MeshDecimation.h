@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+struct PsxSubmesh;
+
+// Makes a less detailed version of the mesh by collapsing the shortest edges
+// until the mesh has at most targetNumFaces faces (or no edge can be collapsed anymore).
+// Quads which lose one corner become triangles, faces which lose more are removed.
+PsxSubmesh decimateMesh(const PsxSubmesh& mesh, std::size_t targetNumFaces);
+
+std::size_t getNumFaces(const PsxSubmesh& mesh);
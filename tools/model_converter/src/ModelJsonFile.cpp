@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <fstream>
+#include <stdexcept>
 #include <nlohmann/json.hpp>
 
 glm::vec2 getVec2(const nlohmann::json& j, std::string_view key, const glm::vec2& defaultValue)
@@ -47,6 +48,71 @@ glm::mat4 Transform::asMatrix() const
     return transformMatrix;
 }
 
+// The game evaluates the armature in one linear pass, so parents must be stored before their
+// children. If they're not, joints are reordered depth-first starting from the root (joint 0)
+// and all joint indices (children, meshes and animation tracks) are remapped.
+void sortJoints(ModelJson& model)
+{
+    auto& armature = model.armature;
+    const auto numJoints = armature.joints.size();
+
+    bool sorted = true;
+    for (std::size_t i = 0; i < numJoints; ++i) {
+        for (const auto childId : armature.joints[i].children) {
+            sorted = sorted && (childId > i);
+        }
+    }
+    if (sorted) {
+        return;
+    }
+
+    std::vector<std::uint8_t> order; // new index -> old index
+    order.reserve(numJoints);
+    std::vector<std::uint8_t> jointsToProcess{0};
+    while (!jointsToProcess.empty()) {
+        const auto id = jointsToProcess.back();
+        jointsToProcess.pop_back();
+        order.push_back(id);
+
+        // pushed in reverse so that the first child is visited first
+        const auto& children = armature.joints[id].children;
+        jointsToProcess.insert(jointsToProcess.end(), children.rbegin(), children.rend());
+    }
+    if (order.size() != numJoints) {
+        throw std::runtime_error("armature has joints which are not reachable from the root");
+    }
+
+    std::vector<std::uint8_t> newIds(numJoints); // old index -> new index
+    for (std::size_t i = 0; i < numJoints; ++i) {
+        newIds[order[i]] = static_cast<std::uint8_t>(i);
+    }
+
+    std::vector<Joint> joints;
+    std::vector<glm::mat4x4> inverseBindMatrices;
+    joints.reserve(numJoints);
+    inverseBindMatrices.reserve(numJoints);
+    for (const auto oldId : order) {
+        auto& joint = joints.emplace_back(std::move(armature.joints[oldId]));
+        for (auto& childId : joint.children) {
+            childId = newIds[childId];
+        }
+        inverseBindMatrices.push_back(armature.inverseBindMatrices[oldId]);
+    }
+    armature.joints = std::move(joints);
+    armature.inverseBindMatrices = std::move(inverseBindMatrices);
+
+    for (auto& mesh : model.meshes) {
+        if (mesh.jointId != -1) {
+            mesh.jointId = newIds[mesh.jointId];
+        }
+    }
+    for (auto& animation : model.animations) {
+        for (auto& track : animation.tracks) {
+            track.jointId = newIds[track.jointId];
+        }
+    }
+}
+
 ModelJson parseJsonFile(
     const std::filesystem::path& path,
     const std::filesystem::path& assetDirPath)
@@ -226,6 +292,8 @@ ModelJson parseJsonFile(
         }
     }
 
+    sortJoints(model);
+
     const auto collisionIt = root.find("collision");
     if (collisionIt != root.end()) {
         const auto& collisionArr = *collisionIt;
@@ -1,7 +1,12 @@
 #include "PsxModel.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
 
 #include <FsUtil.h>
 
@@ -130,6 +135,203 @@ void writeGT4Prims(std::ofstream& file, const std::vector<PsxQuadFace>& faces)
     }
 }
 
+struct IndexedVertices {
+    std::vector<Vec3<FixedPoint4_12>> vertices;
+    std::vector<std::uint16_t> indices;
+};
+
+// Merges vertices with the same position (all other attributes are stored in prims)
+// Indices are stored in the same order as the faces are written:
+// untextured tris, untextured quads, tris, quads
+IndexedVertices buildIndexedVertices(const PsxSubmesh& mesh)
+{
+    using Key = std::tuple<FixedPoint4_12, FixedPoint4_12, FixedPoint4_12>;
+    std::map<Key, std::uint16_t> vertexIndices;
+
+    IndexedVertices res;
+    const auto addVertex = [&res, &vertexIndices](const PsxVert& v) {
+        const auto key = Key{v.pos.x, v.pos.y, v.pos.z};
+        auto it = vertexIndices.find(key);
+        if (it == vertexIndices.end()) {
+            if (res.vertices.size() >= MAX_INDEXED_VERTICES) {
+                throw std::runtime_error("too many vertices in submesh");
+            }
+            const auto idx = static_cast<std::uint16_t>(res.vertices.size());
+            it = vertexIndices.emplace(key, idx).first;
+            res.vertices.push_back(v.pos);
+        }
+        res.indices.push_back(it->second);
+    };
+
+    for (const auto& face : mesh.untexturedTriFaces) {
+        for (const auto& v : face.vs) {
+            addVertex(v);
+        }
+    }
+    for (const auto& face : mesh.untexturedQuadFaces) {
+        for (const auto& v : face.vs) {
+            addVertex(v);
+        }
+    }
+    for (const auto& face : mesh.triFaces) {
+        for (const auto& v : face.vs) {
+            addVertex(v);
+        }
+    }
+    for (const auto& face : mesh.quadFaces) {
+        for (const auto& v : face.vs) {
+            addVertex(v);
+        }
+    }
+
+    return res;
+}
+
+// Bounding volumes (see MeshBounds in the game)
+struct Bounds {
+    Vec3<FixedPoint4_12> min;
+    Vec3<FixedPoint4_12> max;
+    Vec3<FixedPoint4_12> center;
+    std::uint16_t radius; // unsigned 4.12
+};
+
+// radius is rounded up so that the sphere always contains the points
+std::uint16_t toRadius(double r)
+{
+    const auto v = std::ceil(r);
+    if (v > 0xFFFF) {
+        throw std::runtime_error("bounding sphere is too big");
+    }
+    return static_cast<std::uint16_t>(v);
+}
+
+double distance(const Vec3<FixedPoint4_12>& a, const Vec3<FixedPoint4_12>& b)
+{
+    const double dx = a.x - b.x;
+    const double dy = a.y - b.y;
+    const double dz = a.z - b.z;
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+void calculateCenter(Bounds& bounds)
+{
+    bounds.center = {
+        static_cast<FixedPoint4_12>((bounds.min.x + bounds.max.x) / 2),
+        static_cast<FixedPoint4_12>((bounds.min.y + bounds.max.y) / 2),
+        static_cast<FixedPoint4_12>((bounds.min.z + bounds.max.z) / 2),
+    };
+}
+
+Bounds calculateBounds(const std::vector<Vec3<FixedPoint4_12>>& vertices)
+{
+    Bounds bounds{};
+    if (vertices.empty()) {
+        return bounds;
+    }
+
+    bounds.min = vertices[0];
+    bounds.max = vertices[0];
+    for (const auto& v : vertices) {
+        bounds.min.x = std::min(bounds.min.x, v.x);
+        bounds.min.y = std::min(bounds.min.y, v.y);
+        bounds.min.z = std::min(bounds.min.z, v.z);
+        bounds.max.x = std::max(bounds.max.x, v.x);
+        bounds.max.y = std::max(bounds.max.y, v.y);
+        bounds.max.z = std::max(bounds.max.z, v.z);
+    }
+    calculateCenter(bounds);
+
+    double radius = 0.0;
+    for (const auto& v : vertices) {
+        radius = std::max(radius, distance(bounds.center, v));
+    }
+    bounds.radius = toRadius(radius);
+
+    return bounds;
+}
+
+Bounds mergeBounds(const std::vector<Bounds>& submeshBounds)
+{
+    Bounds bounds{};
+    if (submeshBounds.empty()) {
+        return bounds;
+    }
+
+    bounds.min = submeshBounds[0].min;
+    bounds.max = submeshBounds[0].max;
+    for (const auto& b : submeshBounds) {
+        bounds.min.x = std::min(bounds.min.x, b.min.x);
+        bounds.min.y = std::min(bounds.min.y, b.min.y);
+        bounds.min.z = std::min(bounds.min.z, b.min.z);
+        bounds.max.x = std::max(bounds.max.x, b.max.x);
+        bounds.max.y = std::max(bounds.max.y, b.max.y);
+        bounds.max.z = std::max(bounds.max.z, b.max.z);
+    }
+    calculateCenter(bounds);
+
+    double radius = 0.0;
+    for (const auto& b : submeshBounds) {
+        radius = std::max(radius, distance(bounds.center, b.center) + b.radius);
+    }
+    bounds.radius = toRadius(radius);
+
+    return bounds;
+}
+
+void writeBounds(std::ofstream& file, const Bounds& bounds)
+{
+    fsutil::binaryWrite(file, bounds.min.x);
+    fsutil::binaryWrite(file, bounds.min.y);
+    fsutil::binaryWrite(file, bounds.min.z);
+    fsutil::binaryWrite(file, bounds.max.x);
+    fsutil::binaryWrite(file, bounds.max.y);
+    fsutil::binaryWrite(file, bounds.max.z);
+    fsutil::binaryWrite(file, bounds.center.x);
+    fsutil::binaryWrite(file, bounds.center.y);
+    fsutil::binaryWrite(file, bounds.center.z);
+    fsutil::binaryWrite(file, bounds.radius);
+}
+
+void writeSubmesh(std::ofstream& file,
+    const PsxSubmesh& mesh,
+    const IndexedVertices& indexed,
+    const Bounds& bounds)
+{
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.jointId));
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.untexturedTriFaces.size()));
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.untexturedQuadFaces.size()));
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.triFaces.size()));
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.quadFaces.size()));
+
+    writeBounds(file, bounds);
+
+    fsutil::binaryWrite(file, static_cast<std::uint16_t>(indexed.vertices.size()));
+    for (const auto& pos : indexed.vertices) {
+        fsutil::binaryWrite(file, pos.x);
+        fsutil::binaryWrite(file, pos.y);
+        fsutil::binaryWrite(file, pos.z);
+        fsutil::binaryWrite(file, pad16);
+    }
+
+    // 8-bit indices are enough for most meshes
+    const bool smallIndices = indexed.vertices.size() <= 256;
+    for (const auto idx : indexed.indices) {
+        if (smallIndices) {
+            fsutil::binaryWrite(file, static_cast<std::uint8_t>(idx));
+        } else {
+            fsutil::binaryWrite(file, idx);
+        }
+    }
+    if (smallIndices && indexed.indices.size() % 2 != 0) {
+        fsutil::binaryWrite(file, pad8);
+    }
+
+    writeG3Prims(file, mesh.untexturedTriFaces);
+    writeG4Prims(file, mesh.untexturedQuadFaces);
+    writeGT3Prims(file, mesh.triFaces);
+    writeGT4Prims(file, mesh.quadFaces);
+}
+
 } // end of anonymous namespace
 
 void writePsxModel(const PsxModel& model, const std::filesystem::path& path)
@@ -143,54 +345,39 @@ void writePsxModel(const PsxModel& model, std::ofstream& file)
 {
     std::uint16_t flags{0};
     flags |= (!model.armature.joints.empty());
-    // 15 bits unused for now
+    flags |= (1 << 1); // indexed vertices
+    flags |= (1 << 2); // bounds
+
+    const bool hasLods = std::any_of(model.submeshes.begin(),
+        model.submeshes.end(),
+        [](const PsxSubmesh& mesh) { return !mesh.lods.empty(); });
+    flags |= (hasLods << 3);
+    flags |= (1 << 4); // joint parents
+    // 11 bits unused for now
+
+    std::vector<IndexedVertices> indexedVertices;
+    std::vector<Bounds> submeshBounds;
+    for (const auto& mesh : model.submeshes) {
+        indexedVertices.push_back(buildIndexedVertices(mesh));
+        // for skinned meshes, it's in joint space
+        submeshBounds.push_back(calculateBounds(indexedVertices.back().vertices));
+    }
 
     fsutil::binaryWrite(file, flags);
     fsutil::binaryWrite(file, static_cast<std::uint16_t>(model.submeshes.size()));
-    for (const auto& mesh : model.submeshes) {
-        fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.jointId));
-        fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.untexturedTriFaces.size()));
-        fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.untexturedQuadFaces.size()));
-        fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.triFaces.size()));
-        fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.quadFaces.size()));
-
-        for (const auto& face : mesh.untexturedTriFaces) {
-            for (int i = 0; i < 3; ++i) {
-                fsutil::binaryWrite(file, face.vs[i].pos.x);
-                fsutil::binaryWrite(file, face.vs[i].pos.y);
-                fsutil::binaryWrite(file, face.vs[i].pos.z);
-                fsutil::binaryWrite(file, pad16);
-            }
-        }
-        for (const auto& face : mesh.untexturedQuadFaces) {
-            for (int i = 0; i < 4; ++i) {
-                fsutil::binaryWrite(file, face.vs[i].pos.x);
-                fsutil::binaryWrite(file, face.vs[i].pos.y);
-                fsutil::binaryWrite(file, face.vs[i].pos.z);
-                fsutil::binaryWrite(file, pad16);
-            }
-        }
-        for (const auto& face : mesh.triFaces) {
-            for (int i = 0; i < 3; ++i) {
-                fsutil::binaryWrite(file, face.vs[i].pos.x);
-                fsutil::binaryWrite(file, face.vs[i].pos.y);
-                fsutil::binaryWrite(file, face.vs[i].pos.z);
-                fsutil::binaryWrite(file, pad16);
-            }
-        }
-        for (const auto& face : mesh.quadFaces) {
-            for (int i = 0; i < 4; ++i) {
-                fsutil::binaryWrite(file, face.vs[i].pos.x);
-                fsutil::binaryWrite(file, face.vs[i].pos.y);
-                fsutil::binaryWrite(file, face.vs[i].pos.z);
-                fsutil::binaryWrite(file, pad16);
+    writeBounds(file, mergeBounds(submeshBounds));
+    for (std::size_t i = 0; i < model.submeshes.size(); ++i) {
+        const auto& mesh = model.submeshes[i];
+        writeSubmesh(file, mesh, indexedVertices[i], submeshBounds[i]);
+
+        if (hasLods) {
+            fsutil::binaryWrite(file, static_cast<std::uint16_t>(mesh.lods.size()));
+            for (const auto& lod : mesh.lods) {
+                fsutil::binaryWrite(file, lod.lodDistance);
+                const auto indexed = buildIndexedVertices(lod);
+                writeSubmesh(file, lod, indexed, calculateBounds(indexed.vertices));
             }
         }
-
-        writeG3Prims(file, mesh.untexturedTriFaces);
-        writeG4Prims(file, mesh.untexturedQuadFaces);
-        writeGT3Prims(file, mesh.triFaces);
-        writeGT4Prims(file, mesh.quadFaces);
     }
 
     if (!model.armature.joints.empty()) {
@@ -207,6 +394,8 @@ void writePsxModel(const PsxModel& model, std::ofstream& file)
             fsutil::binaryWrite(file, joint.rotation.w);
             fsutil::binaryWrite(file, joint.firstChild);
             fsutil::binaryWrite(file, joint.nextSibling);
+            fsutil::binaryWrite(file, joint.parent);
+            fsutil::binaryWrite(file, std::uint8_t{}); // pad
         }
     }
 }
@@ -42,8 +42,16 @@ struct PsxSubmesh {
     std::vector<PsxQuadFace> untexturedQuadFaces;
     std::vector<PsxTriFace> triFaces;
     std::vector<PsxQuadFace> quadFaces;
+
+    // less detailed versions of the submesh, from the most to the least detailed
+    std::vector<PsxSubmesh> lods;
+    // view space distance starting from which this submesh is drawn (only set for LODs)
+    FixedPoint4_12 lodDistance{0};
 };
 
+// max number of LODs stored per submesh (not counting the submesh itself)
+inline constexpr std::size_t MAX_SUBMESH_LODS = 2;
+
 struct PsxJoint {
     using JointId = std::uint8_t;
     static constexpr JointId NULL_JOINT_ID = 0xFF;
@@ -52,6 +60,8 @@ struct PsxJoint {
     Vec4<FixedPoint4_12> rotation;
     JointId firstChild{NULL_JOINT_ID};
     JointId nextSibling{NULL_JOINT_ID};
+    // joints are sorted so that the parent always goes before its children
+    JointId parent{NULL_JOINT_ID};
 };
 
 struct PsxMatrix {
@@ -65,6 +75,9 @@ struct PsxArmature {
     std::vector<PsxMatrix> inverseBindMatrices;
 };
 
+// max number of unique vertices in a submesh
+inline constexpr std::size_t MAX_INDEXED_VERTICES = 0xFFFF;
+
 struct PsxModel {
     std::vector<PsxSubmesh> submeshes;
     PsxArmature armature;
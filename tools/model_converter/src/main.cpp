@@ -29,6 +29,12 @@ int main(int argc, char* argv[])
         ->required()
         ->check(CLI::ExistingDirectory);
 
+    int numLods = 2;
+    cliApp
+        .add_option(
+            "--lods", numLods, "Number of LODs generated for submeshes without hand-made LODs")
+        ->check(CLI::Range(0, static_cast<int>(MAX_SUBMESH_LODS)));
+
     try {
         cliApp.parse(argc, argv);
     } catch (const CLI::ParseError& e) {
@@ -44,6 +50,7 @@ int main(int argc, char* argv[])
     // convert
     ConversionParams conversionParams{
         .scale = 1.f / 8.f,
+        .numLods = numLods,
     };
 
     const auto modelJson = parseJsonFile(inputFilePath, assetDirPath);
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <DJBHash.h>
+#include <FsUtil.h>
+
+// Packs files into one archive which the game reads with CDLoader::openArchive.
+//
+// Layout (all offsets/sizes are little-endian u32):
+//   magic ("PACK"), number of entries, number of sectors taken by the header
+//   entries sorted by hash: hash, first sector (from the start of the archive), size in bytes
+//   files, each of them starts at a sector boundary
+//
+// The hashes are DJB hashes of the files' ISO names ("CATO.FM;1") - the same names which the
+// game passes to CDLoader, so it finds files without any ISO9660 lookups.
+
+namespace
+{
+constexpr std::uint32_t PACK_MAGIC = 0x4B434150; // "PACK"
+constexpr std::uint32_t SECTOR_SIZE = 2048;
+
+struct PackedFile {
+    std::string name;
+    std::filesystem::path path;
+    std::uint32_t hash{};
+    std::uint32_t sector{};
+    std::vector<char> data;
+};
+
+std::uint32_t sizeInSectors(std::size_t size)
+{
+    return static_cast<std::uint32_t>((size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+}
+
+void writePadding(std::ofstream& file, std::size_t size)
+{
+    const auto padding = sizeInSectors(size) * SECTOR_SIZE - size;
+    for (std::size_t i = 0; i < padding; ++i) {
+        fsutil::binaryWrite(file, std::uint8_t{});
+    }
+}
+
+// "NAME=path" -> NAME;1 and path
+PackedFile parseFileArg(const std::string& arg)
+{
+    const auto sep = arg.find('=');
+    if (sep == std::string::npos || sep == 0 || sep + 1 == arg.size()) {
+        throw std::runtime_error("bad file argument (should be NAME=path): " + arg);
+    }
+
+    PackedFile file{
+        .name = arg.substr(0, sep) + ";1",
+        .path = arg.substr(sep + 1),
+    };
+    file.hash = DJBHash::hash(file.name);
+
+    std::ifstream is(file.path, std::ios::binary);
+    if (!is.good()) {
+        throw std::runtime_error("failed to open " + file.path.string());
+    }
+    file.data.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    return file;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App cliApp{};
+
+    std::filesystem::path outputFilePath;
+    cliApp.add_option("OUTPUTFILE", outputFilePath, "Output file")->required();
+
+    std::vector<std::string> fileArgs;
+    cliApp.add_option("FILES", fileArgs, "Files to pack (NAME=path, e.g. CATO.FM=cato.fm)")
+        ->required();
+
+    try {
+        cliApp.parse(argc, argv);
+    } catch (const CLI::ParseError& e) {
+        std::exit(cliApp.exit(e));
+    }
+
+    std::vector<PackedFile> files;
+    try {
+        for (const auto& arg : fileArgs) {
+            files.push_back(parseFileArg(arg));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) {
+        return a.hash < b.hash;
+    });
+    for (std::size_t i = 1; i < files.size(); ++i) {
+        if (files[i].hash == files[i - 1].hash) {
+            std::cerr << "hash collision: " << files[i - 1].name << " and " << files[i].name
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    const auto headerSize = sizeof(std::uint32_t) * (3 + 3 * files.size());
+    const auto headerSectors = sizeInSectors(headerSize);
+    auto sector = headerSectors;
+    for (auto& file : files) {
+        file.sector = sector;
+        sector += sizeInSectors(file.data.size());
+    }
+
+    std::ofstream os(outputFilePath, std::ios::binary);
+    fsutil::binaryWrite(os, PACK_MAGIC);
+    fsutil::binaryWrite(os, static_cast<std::uint32_t>(files.size()));
+    fsutil::binaryWrite(os, headerSectors);
+    for (const auto& file : files) {
+        fsutil::binaryWrite(os, file.hash);
+        fsutil::binaryWrite(os, file.sector);
+        fsutil::binaryWrite(os, static_cast<std::uint32_t>(file.data.size()));
+    }
+    writePadding(os, headerSize);
+
+    for (const auto& file : files) {
+        std::cout << file.name << " <- " << file.path << " (sector " << file.sector << ", "
+                  << file.data.size() << " bytes)" << std::endl;
+        os.write(file.data.data(), file.data.size());
+        writePadding(os, file.data.size());
+    }
+
+    std::cout << "Wrote " << outputFilePath << " (" << sector << " sectors)" << std::endl;
+}
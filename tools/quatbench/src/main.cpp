@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <CLI/CLI.hpp>
+
+// Checks the game's fixed-point quaternion math (Quaternion::normalize and nlerp in
+// games/cat_adventure/src/Math/Quaternion.cpp) against a double precision reference.
+//
+// The integer math is copied from the game with GTE operations replaced by what they compute,
+// so the results are bit-exact. Keep it in sync when changing Quaternion.cpp.
+//
+// Cycle counts are estimates: only multiplies and GTE work are counted (ALU instructions,
+// loads/stores and branches aren't), using psx-spx timings:
+//   mult - 6/9/13 cycles depending on the magnitude of the first operand
+//   sqr, gpf - 5 cycles, lzc - 2 cycles, GTE register transfer - 1 cycle
+
+namespace
+{
+struct Quat {
+    std::int16_t w, x, y, z;
+};
+
+struct QuatD {
+    double w, x, y, z;
+};
+
+// --- cycle estimates
+
+std::uint64_t cycles = 0;
+
+std::int32_t mul(std::int32_t a, std::int32_t b)
+{
+    const auto absA = a < 0 ? -(std::int64_t)a : (std::int64_t)a;
+    cycles += (absA < 0x800) ? 6 : (absA < 0x100000) ? 9 : 13;
+    return (std::int32_t)((std::int64_t)a * b);
+}
+
+std::uint32_t mulu(std::uint32_t a, std::uint32_t b)
+{
+    cycles += (a < 0x800) ? 6 : (a < 0x100000) ? 9 : 13;
+    return a * b;
+}
+
+void gteTransfers(int count)
+{
+    cycles += count;
+}
+
+void gteCommand(int c)
+{
+    cycles += c;
+}
+
+// --- the game's math (see Quaternion.cpp)
+
+constexpr int INV_SQRT_TABLE_SIZE = 96;
+std::uint16_t invSqrtTable[INV_SQRT_TABLE_SIZE];
+
+void makeInvSqrtTable()
+{
+    for (int i = 0; i < INV_SQRT_TABLE_SIZE; ++i) {
+        const std::uint64_t m = (i + 32) * 32 + 16;
+        const auto v = (std::uint64_t)std::sqrt((double)((1ull << 40) / m));
+        // same as constexprSqrt: the largest integer whose square fits
+        auto res = v + 1;
+        while (res * res > (1ull << 40) / m) {
+            --res;
+        }
+        invSqrtTable[i] = (std::uint16_t)res;
+    }
+}
+
+int countLeadingZeroes(std::int32_t v)
+{
+    int n = 0;
+    for (int bit = 31; bit >= 0 && !(v & (1 << bit)); --bit) {
+        ++n;
+    }
+    return n;
+}
+
+std::int32_t inverseSqrt(std::int32_t s)
+{
+    auto m = s >> 12;
+    int shift = 0;
+    if (s >= (1 << 24)) {
+        m = s >> 14;
+        shift = 1;
+    }
+    const std::int32_t r = invSqrtTable[(m >> 5) - 32] >> shift;
+
+    const auto srr = mulu((std::uint32_t)(s >> 10), (std::uint32_t)(mul(r, r) >> 14)) >> 16;
+    return std::min(mul(r, 3 * 4096 - (std::int32_t)srr) >> 13, 32767);
+}
+
+Quat normalize(Quat q)
+{
+    std::int32_t c[4] = {q.w, q.x, q.y, q.z};
+    std::int32_t maxAbs = 0;
+    for (const auto v : c) {
+        maxAbs = std::max(maxAbs, std::abs(v));
+    }
+    if (maxAbs == 0) {
+        return Quat{4096, 0, 0, 0};
+    }
+
+    gteTransfers(2);
+    gteCommand(2);
+    const int shift = countLeadingZeroes(maxAbs) - 20;
+    for (auto& v : c) {
+        v = (shift >= 0) ? (v << shift) : (v >> -shift);
+    }
+
+    // sqr
+    gteTransfers(3);
+    gteCommand(5);
+    gteTransfers(3);
+    const auto s = mul(c[0], c[0]) + c[1] * c[1] + c[2] * c[2] + c[3] * c[3];
+
+    const auto r = inverseSqrt(s);
+
+    // gpf
+    gteTransfers(4);
+    gteCommand(5);
+    gteTransfers(3);
+    const auto rx = c[1] * r;
+    const auto ry = c[2] * r;
+    const auto rz = c[3] * r;
+
+    return Quat{
+        (std::int16_t)((mul(c[0], r) + (1 << 13)) >> 14),
+        (std::int16_t)((rx + (1 << 13)) >> 14),
+        (std::int16_t)((ry + (1 << 13)) >> 14),
+        (std::int16_t)((rz + (1 << 13)) >> 14),
+    };
+}
+
+std::int16_t lerpRaw(std::int32_t a, std::int32_t b, std::int32_t factor)
+{
+    return (std::int16_t)(a + ((mul(b - a, factor) + (1 << 11)) >> 12));
+}
+
+Quat nlerp(const Quat& q1, const Quat& q2, std::int32_t factor)
+{
+    const auto dot = mul(q1.w, q2.w) + mul(q1.x, q2.x) + mul(q1.y, q2.y) + mul(q1.z, q2.z);
+    const std::int32_t sign = (dot < 0) ? -1 : 1;
+
+    const Quat res{
+        lerpRaw(q1.w, sign * q2.w, factor),
+        lerpRaw(q1.x, sign * q2.x, factor),
+        lerpRaw(q1.y, sign * q2.y, factor),
+        lerpRaw(q1.z, sign * q2.z, factor),
+    };
+    return normalize(res);
+}
+
+// --- reference
+
+QuatD toDouble(const Quat& q)
+{
+    return QuatD{q.w / 4096.0, q.x / 4096.0, q.y / 4096.0, q.z / 4096.0};
+}
+
+QuatD normalizeRef(const QuatD& q)
+{
+    const auto len = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    return QuatD{q.w / len, q.x / len, q.y / len, q.z / len};
+}
+
+QuatD nlerpRef(const QuatD& q1, QuatD q2, double t)
+{
+    if (q1.w * q2.w + q1.x * q2.x + q1.y * q2.y + q1.z * q2.z < 0.0) {
+        q2 = QuatD{-q2.w, -q2.x, -q2.y, -q2.z};
+    }
+    return normalizeRef(QuatD{
+        q1.w + (q2.w - q1.w) * t,
+        q1.x + (q2.x - q1.x) * t,
+        q1.y + (q2.y - q1.y) * t,
+        q1.z + (q2.z - q1.z) * t,
+    });
+}
+
+// --- stats
+
+struct Stats {
+    double maxError{0.0}; // max component error, in 4.12 LSB
+    double maxLengthError{0.0}; // max |length - 1|, in 4.12 LSB
+    std::uint64_t numCases{0};
+    std::uint64_t cycles{0};
+    std::uint64_t maxCycles{0};
+
+    void add(const Quat& res, const QuatD& ref, std::uint64_t caseCycles)
+    {
+        const auto r = toDouble(res);
+        const double errors[4] = {r.w - ref.w, r.x - ref.x, r.y - ref.y, r.z - ref.z};
+        for (const auto e : errors) {
+            maxError = std::max(maxError, std::abs(e) * 4096.0);
+        }
+        const auto len = std::sqrt(r.w * r.w + r.x * r.x + r.y * r.y + r.z * r.z);
+        maxLengthError = std::max(maxLengthError, std::abs(len - 1.0) * 4096.0);
+        ++numCases;
+        cycles += caseCycles;
+        maxCycles = std::max(maxCycles, caseCycles);
+    }
+
+    void print(const std::string& name) const
+    {
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << numCases << std::setw(12)
+                  << maxError << std::setw(12) << maxLengthError << std::setw(12)
+                  << (double)cycles / (double)numCases << std::setw(12) << maxCycles
+                  << std::endl;
+    }
+};
+
+Quat randomQuat(std::mt19937& rng, double length)
+{
+    std::normal_distribution<double> dist;
+    QuatD q{dist(rng), dist(rng), dist(rng), dist(rng)};
+    q = normalizeRef(q);
+    const auto toRaw = [length](double v) {
+        return (std::int16_t)std::clamp(std::lround(v * length * 4096.0), -32767l, 32767l);
+    };
+    return Quat{toRaw(q.w), toRaw(q.x), toRaw(q.y), toRaw(q.z)};
+}
+
+// q rotated by a small random angle (like two neighbouring animation keys)
+Quat nearbyQuat(std::mt19937& rng, const Quat& q, double maxAngle)
+{
+    std::uniform_real_distribution<double> angleDist(-maxAngle, maxAngle);
+    const auto d = normalizeRef(QuatD{1.0, angleDist(rng), angleDist(rng), angleDist(rng)});
+    const auto a = toDouble(q);
+    const QuatD res{
+        a.w * d.w - a.x * d.x - a.y * d.y - a.z * d.z,
+        a.w * d.x + a.x * d.w + a.y * d.z - a.z * d.y,
+        a.w * d.y - a.x * d.z + a.y * d.w + a.z * d.x,
+        a.w * d.z + a.x * d.y - a.y * d.x + a.z * d.w,
+    };
+    const auto toRaw = [](double v) { return (std::int16_t)std::lround(v * 4096.0); };
+    return Quat{toRaw(res.w), toRaw(res.x), toRaw(res.y), toRaw(res.z)};
+}
+
+Stats benchNormalize(std::mt19937& rng, int count, double minLength, double maxLength)
+{
+    std::uniform_real_distribution<double> lengthDist(std::log2(minLength), std::log2(maxLength));
+    Stats stats;
+    for (int i = 0; i < count; ++i) {
+        const auto q = randomQuat(rng, std::exp2(lengthDist(rng)));
+        if (q.w == 0 && q.x == 0 && q.y == 0 && q.z == 0) {
+            continue;
+        }
+        cycles = 0;
+        const auto res = normalize(q);
+        stats.add(res, normalizeRef(toDouble(q)), cycles);
+    }
+    return stats;
+}
+
+Stats benchNlerp(std::mt19937& rng, int count, double maxAngle)
+{
+    std::uniform_int_distribution<std::int32_t> factorDist(0, 4096);
+    Stats stats;
+    for (int i = 0; i < count; ++i) {
+        const auto q1 = randomQuat(rng, 1.0);
+        const auto q2 = (maxAngle > 0.0) ? nearbyQuat(rng, q1, maxAngle) : randomQuat(rng, 1.0);
+        const auto factor = factorDist(rng);
+        cycles = 0;
+        const auto res = nlerp(q1, q2, factor);
+        stats.add(res, nlerpRef(toDouble(q1), toDouble(q2), factor / 4096.0), cycles);
+    }
+    return stats;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App cliApp{};
+
+    int count = 200000;
+    cliApp.add_option("-n,--count", count, "Number of random cases per test");
+
+    std::uint32_t seed = 1;
+    cliApp.add_option("--seed", seed, "Random seed");
+
+    try {
+        cliApp.parse(argc, argv);
+    } catch (const CLI::ParseError& e) {
+        std::exit(cliApp.exit(e));
+    }
+
+    makeInvSqrtTable();
+    std::mt19937 rng(seed);
+
+    std::cout << std::left << std::setw(24) << "test" << std::right << std::setw(10) << "cases"
+              << std::setw(12) << "max err" << std::setw(12) << "max |len-1|" << std::setw(12)
+              << "avg cycles" << std::setw(12) << "max cycles" << std::endl;
+
+    benchNormalize(rng, count, 0.99, 1.01).print("normalize ~unit");
+    benchNormalize(rng, count, 1.0 / 64.0, 1.0).print("normalize short");
+    benchNormalize(rng, count, 1.0, 7.99).print("normalize long");
+    benchNlerp(rng, count, 0.0).print("nlerp random pairs");
+    benchNlerp(rng, count, 0.1).print("nlerp nearby keys");
+
+    std::cout << "errors are in 4.12 LSB, cycles only include multiplies and GTE work"
+              << std::endl;
+}